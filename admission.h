@@ -0,0 +1,146 @@
+// Admission control for the vector add daemon: keeps the memory admitted work needs within
+// what the node can give, and tells clients to back off instead of letting queues grow.
+//
+// Every request is costed before it runs:
+//   host bytes    registered client regions (shared memory the node has to back)
+//   device bytes  three buffers of the vector size for adds run on the OpenCL device
+//   memory time   3 * size * sizeof(int) / bandwidth: how long the add occupies DRAM
+// A request that can never fit (a region larger than the host budget, a buffer larger than
+// CL_DEVICE_MAX_MEM_ALLOC_SIZE, three larger than the device budget) is rejected. One that
+// would push the admitted backlog past max_backlog_ms is answered busy with a retry-after
+// hint (backpressure). Otherwise it is admitted and, if device memory is short, queued until
+// running adds release enough; its memory time joins the backlog only once it has the device
+// memory, so adds waiting for the device do not push host adds into VA_BUSY.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include "cgroup_limits.h"
+#include "ocl_common.h"
+
+enum AdmitResult { ADMIT_OK, ADMIT_REJECT, ADMIT_BUSY };
+
+// Budgets, current use and counters; everything below the budgets is guarded by mu
+struct Admission {
+    long host_budget;      // Bytes of client regions the daemon accepts
+    long device_budget;    // Bytes of device buffers in flight (0 without a device)
+    long device_max_alloc; // Largest single device buffer
+    double bandwidth_gbs;  // Memory bandwidth used to cost requests
+    double max_backlog_ms; // Longest queue (in memory time) before clients are told to retry
+
+    std::mutex mu;
+    std::condition_variable freed;
+    long host_used, device_used;
+    double backlog_ms;            // Memory time of admitted adds not yet finished
+    long rejected, busy, queued;  // Requests refused for good, told to retry, made to wait
+};
+
+// Host memory available to this process: MemAvailable, capped by the cgroup limit headroom
+static inline long host_memory_available() {
+    long available = 0;
+    char line[256];
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "MemAvailable: %ld kB", &available) == 1) {
+                available *= 1024;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    CgroupLimits cg;
+    cgroup_detect(&cg);
+    long headroom = cgroup_memory_headroom(&cg);
+    if (headroom >= 0 && headroom < available) {
+        available = headroom;
+    }
+    return available;
+}
+
+// Host budget: host_fraction of the memory available now; no device until admission_set_device
+static inline void admission_init(Admission *a, double host_fraction, double bandwidth_gbs, double max_backlog_ms) {
+    a->host_budget = (long)(host_memory_available() * host_fraction);
+    a->device_budget = 0;
+    a->device_max_alloc = 0;
+    a->bandwidth_gbs = bandwidth_gbs;
+    a->max_backlog_ms = max_backlog_ms;
+    a->host_used = a->device_used = 0;
+    a->backlog_ms = 0;
+    a->rejected = a->busy = a->queued = 0;
+}
+
+// Device budget: device_fraction of CL_DEVICE_GLOBAL_MEM_SIZE, single buffers up to
+// CL_DEVICE_MAX_MEM_ALLOC_SIZE
+static inline void admission_set_device(Admission *a, cl_device_id dev, double device_fraction) {
+    cl_ulong global_mem = 0, max_alloc = 0;
+    clGetDeviceInfo(dev, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL);
+    clGetDeviceInfo(dev, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+    a->device_budget = (long)(global_mem * device_fraction);
+    a->device_max_alloc = (long)max_alloc;
+}
+
+// Memory time of an add of size elements
+static inline double admission_cost_ms(const Admission *a, long size) {
+    return 3.0 * size * sizeof(int) / (a->bandwidth_gbs * 1e6);
+}
+
+// Account a client region of bytes; busy if other regions hold the memory it needs
+static inline AdmitResult admission_register(Admission *a, long bytes) {
+    std::lock_guard<std::mutex> lock(a->mu);
+    if (bytes > a->host_budget) {
+        a->rejected++;
+        return ADMIT_REJECT;
+    }
+    if (a->host_used + bytes > a->host_budget) {
+        a->busy++;
+        return ADMIT_BUSY;
+    }
+    a->host_used += bytes;
+    return ADMIT_OK;
+}
+
+// Release a region accounted by admission_register
+static inline void admission_unregister(Admission *a, long bytes) {
+    std::lock_guard<std::mutex> lock(a->mu);
+    a->host_used -= bytes;
+}
+
+// Admit an add of size elements (on the device if on_device), waiting for device memory if
+// needed. On ADMIT_BUSY, *retry_after_us says when the backlog should be short enough.
+static inline AdmitResult admission_acquire(Admission *a, long size, bool on_device, long *retry_after_us) {
+    long buffer = size * sizeof(int);
+    long device_bytes = on_device ? 3 * buffer : 0;
+    double ms = admission_cost_ms(a, size);
+    std::unique_lock<std::mutex> lock(a->mu);
+    if (on_device && (buffer > a->device_max_alloc || device_bytes > a->device_budget)) {
+        a->rejected++;
+        return ADMIT_REJECT;
+    }
+    if (a->backlog_ms > 0 && a->backlog_ms + ms > a->max_backlog_ms) {
+        a->busy++;
+        *retry_after_us = (long)((a->backlog_ms + ms - a->max_backlog_ms) * 1000);
+        return ADMIT_BUSY;
+    }
+    if (a->device_used + device_bytes > a->device_budget) {
+        a->queued++;
+        a->freed.wait(lock, [&]() { return a->device_used + device_bytes <= a->device_budget; });
+    }
+    a->device_used += device_bytes;
+    a->backlog_ms += ms;
+    return ADMIT_OK;
+}
+
+// Release what admission_acquire granted for the same add
+static inline void admission_release(Admission *a, long size, bool on_device) {
+    std::lock_guard<std::mutex> lock(a->mu);
+    a->device_used -= on_device ? 3 * size * sizeof(int) : 0;
+    a->backlog_ms -= admission_cost_ms(a, size);
+    if (a->backlog_ms < 1e-9) {
+        a->backlog_ms = 0; // Rounding residue
+    }
+    a->freed.notify_all();
+}
@@ -0,0 +1,156 @@
+// Background load for interference measurements: threads that compete with the code under
+// test the way co-located services do.
+//
+// Kinds:
+//   bandwidth  streams through a private buffer (--ant-mb per thread, far larger than any
+//              cache), reading and writing every line: takes DRAM bandwidth
+//   cache      updates random lines of a buffer the size of the last-level cache: evicts
+//              the victim's lines without using much bandwidth
+// Each thread is pinned to the next CPU of the given list (none: the scheduler places it) and
+// its buffer is first touched by that thread, so with the CPUs of one node the load stays on
+// that node's memory. Threads count the bytes they move so the report can show how hard the
+// antagonists actually ran next to the victim. Link with -lnuma (antagonist_node_cpus).
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <numa.h>
+
+enum AntagonistKind { ANT_BANDWIDTH, ANT_CACHE };
+static const char *ANTAGONIST_NAMES[] = {"bandwidth", "cache"};
+
+#define ANT_LINE 64                   // Bytes per cache line
+#define ANT_CACHE_DEFAULT (8L << 20)  // Cache buffer when sysconf does not know the LLC size
+
+// Running antagonist threads
+struct Antagonist {
+    std::vector<std::thread> threads;
+    std::vector<long *> buffers; // One per thread, allocated by antagonist_start
+    std::atomic<bool> stop{false};
+    std::atomic<long> bytes{0}; // Moved by all threads since start
+};
+
+// Kind by name, -1 if unknown
+static inline int antagonist_parse(const char *name) {
+    for (int k = 0; k < 2; k++) {
+        if (strcmp(name, ANTAGONIST_NAMES[k]) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+// CPUs from a list like "2,3,8-11"
+static inline std::vector<int> antagonist_cpu_list(const char *list) {
+    std::vector<int> cpus;
+    while (list != NULL && *list != '\0') {
+        char *end;
+        int lo = (int)strtol(list, &end, 10);
+        int hi = *end == '-' ? (int)strtol(end + 1, &end, 10) : lo;
+        for (int c = lo; c <= hi; c++) {
+            cpus.push_back(c);
+        }
+        list = *end == ',' ? end + 1 : NULL;
+    }
+    return cpus;
+}
+
+// CPUs of a NUMA node (empty if NUMA is not available)
+static inline std::vector<int> antagonist_node_cpus(int node) {
+    std::vector<int> cpus;
+    if (numa_available() < 0 || node > numa_max_node()) {
+        return cpus;
+    }
+    struct bitmask *mask = numa_allocate_cpumask();
+    if (numa_node_to_cpus(node, mask) == 0) {
+        for (unsigned c = 0; c < mask->size; c++) {
+            if (numa_bitmask_isbitset(mask, c)) {
+                cpus.push_back(c);
+            }
+        }
+    }
+    numa_bitmask_free(mask);
+    return cpus;
+}
+
+// Body of one antagonist thread, working on buf of buffer_bytes
+static inline void antagonist_run(Antagonist *a, AntagonistKind kind, int cpu, long *buf, long buffer_bytes) {
+    if (cpu >= 0) {
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+    }
+    long words = buffer_bytes / sizeof(long);
+    memset(buf, 0, words * sizeof(long)); // First touch from the pinned thread
+    uint64_t state = 0x9e3779b97f4a7c15ULL ^ (uint64_t)cpu;
+    long lines = buffer_bytes / ANT_LINE;
+    while (!a->stop.load(std::memory_order_relaxed)) {
+        if (kind == ANT_BANDWIDTH) {
+            for (long i = 0; i < words; i++) {
+                buf[i] += 1;
+            }
+            a->bytes += 2 * words * sizeof(long);
+        } else {
+            for (long n = 0; n < lines; n++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                buf[(state % lines) * (ANT_LINE / sizeof(long))] += 1;
+            }
+            a->bytes += lines * ANT_LINE;
+        }
+    }
+}
+
+// Start count threads of kind on cpus (round-robin; empty: unpinned). bytes is the buffer per
+// thread for bandwidth; cache threads size theirs to the last-level cache. Returns false (with
+// a message, nothing started) if the buffers cannot be allocated.
+static inline bool antagonist_start(Antagonist *a, AntagonistKind kind, int count, const std::vector<int> &cpus,
+                                    long bytes) {
+    a->stop = false;
+    a->bytes = 0;
+    if (kind == ANT_CACHE) {
+        long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        bytes = llc > 0 ? llc : ANT_CACHE_DEFAULT;
+    }
+    // Allocated here but first touched by each pinned thread (large blocks are untouched mappings)
+    for (int t = 0; t < count; t++) {
+        long *buf = bytes >= ANT_LINE ? (long *)malloc(bytes) : NULL;
+        if (buf == NULL) {
+            fprintf(stderr, "Couldn't allocate a %ld-byte %s antagonist buffer\n", bytes, ANTAGONIST_NAMES[kind]);
+            for (long *b : a->buffers) {
+                free(b);
+            }
+            a->buffers.clear();
+            return false;
+        }
+        a->buffers.push_back(buf);
+    }
+    for (int t = 0; t < count; t++) {
+        int cpu = cpus.empty() ? -1 : cpus[t % cpus.size()];
+        a->threads.emplace_back(antagonist_run, a, kind, cpu, a->buffers[t], bytes);
+    }
+    return true;
+}
+
+// Stop and join the threads
+static inline void antagonist_stop(Antagonist *a) {
+    a->stop = true;
+    for (std::thread &t : a->threads) {
+        t.join();
+    }
+    a->threads.clear();
+    for (long *b : a->buffers) {
+        free(b);
+    }
+    a->buffers.clear();
+}
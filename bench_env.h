@@ -0,0 +1,193 @@
+// Capture of machine settings that change bandwidth results, for result records and warnings
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cgroup_limits.h"
+
+// Ordered key=value pairs describing the machine a result was measured on
+struct BenchEnv {
+    std::vector<std::pair<std::string, std::string>> items;
+};
+
+// First line of a /sys or /proc file without the newline, or "n/a" if unreadable
+static inline std::string env_read_line(const char *path) {
+    char buf[512];
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return "n/a";
+    }
+    if (fgets(buf, sizeof(buf), f) == NULL) {
+        buf[0] = '\0';
+    }
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return buf;
+}
+
+// Add a key, replacing blanks so each record stays one whitespace-separated line
+static inline void env_set(BenchEnv *env, const char *key, std::string value) {
+    for (char &c : value) {
+        if (c == ' ' || c == '\t') {
+            c = '_';
+        }
+    }
+    if (value.empty()) {
+        value = "n/a";
+    }
+    for (auto &item : env->items) {
+        if (item.first == key) {
+            item.second = value;
+            return;
+        }
+    }
+    env->items.push_back(std::make_pair(std::string(key), value));
+}
+
+// Value of a key, or "n/a"
+static inline std::string env_get(const BenchEnv *env, const char *key) {
+    for (const auto &item : env->items) {
+        if (item.first == key) {
+            return item.second;
+        }
+    }
+    return "n/a";
+}
+
+// Capture host settings from /sys and /proc
+static inline void env_capture(BenchEnv *env) {
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    env_set(env, "host", host);
+
+    struct utsname uts;
+    if (uname(&uts) == 0) {
+        env_set(env, "kernel", uts.release);
+    }
+
+    // CPU model from /proc/cpuinfo
+    std::string model = "n/a";
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f != NULL) {
+        char line[512];
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (strncmp(line, "model name", 10) == 0 && strchr(line, ':') != NULL) {
+                model = strchr(line, ':') + 2;
+                model.erase(model.find_last_not_of("\n") + 1);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    env_set(env, "cpu", model);
+    env_set(env, "online_cpus", std::to_string(sysconf(_SC_NPROCESSORS_ONLN)));
+
+    // Frequency governor and turbo (intel_pstate reports no_turbo, acpi-cpufreq reports boost)
+    env_set(env, "governor", env_read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"));
+    std::string no_turbo = env_read_line("/sys/devices/system/cpu/intel_pstate/no_turbo");
+    std::string boost = env_read_line("/sys/devices/system/cpu/cpufreq/boost");
+    if (no_turbo != "n/a") {
+        env_set(env, "turbo", no_turbo == "0" ? "on" : "off");
+    } else if (boost != "n/a") {
+        env_set(env, "turbo", boost == "1" ? "on" : "off");
+    } else {
+        env_set(env, "turbo", "n/a");
+    }
+
+    // Transparent huge pages: the active mode is the bracketed word, e.g. "always [madvise] never"
+    std::string thp = env_read_line("/sys/kernel/mm/transparent_hugepage/enabled");
+    size_t open = thp.find('['), close = thp.find(']');
+    if (open != std::string::npos && close != std::string::npos) {
+        thp = thp.substr(open + 1, close - open - 1);
+    }
+    env_set(env, "thp", thp);
+
+    env_set(env, "numa_balancing", env_read_line("/proc/sys/kernel/numa_balancing"));
+    env_set(env, "smt", env_read_line("/sys/devices/system/cpu/smt/control"));
+
+    // Container limits: CPUs of quota, CPUs in the cpuset/affinity mask, memory limit in MB
+    CgroupLimits cg;
+    cgroup_detect(&cg);
+    char value[32];
+    env_set(env, "cgroup", cg.version > 0 ? "v" + std::to_string(cg.version) : "n/a");
+    snprintf(value, sizeof(value), "%.2f", cg.cpu_quota);
+    env_set(env, "cpu_quota", cg.cpu_quota > 0 ? value : "max");
+    env_set(env, "cpuset_cpus", std::to_string(cg.cpuset_cpus));
+    env_set(env, "mem_limit_mb", cg.memory_limit > 0 ? std::to_string(cg.memory_limit >> 20) : "max");
+}
+
+// Print the record as a single "# env key=value ..." line
+static inline void env_print(const BenchEnv *env, FILE *out) {
+    fprintf(out, "# env");
+    for (const auto &item : env->items) {
+        fprintf(out, " %s=%s", item.first.c_str(), item.second.c_str());
+    }
+    fprintf(out, "\n");
+}
+
+// Parse a line written by env_print; returns false if it is not an env record
+static inline bool env_parse(BenchEnv *env, const char *line) {
+    if (strncmp(line, "# env", 5) != 0) {
+        return false;
+    }
+    char key[128], value[512];
+    const char *p = line + 5;
+    int used;
+    while (sscanf(p, " %127[^= \n]=%511s%n", key, value, &used) == 2) {
+        env_set(env, key, value);
+        p += used;
+    }
+    return true;
+}
+
+// Warn on stderr about settings known to distort bandwidth measurements
+static inline void env_warn(const BenchEnv *env) {
+    std::string governor = env_get(env, "governor");
+    if (governor != "n/a" && governor != "performance") {
+        fprintf(stderr, "WARNING: CPU governor is '%s'; frequency ramps distort short runs (use 'performance')\n", governor.c_str());
+    }
+    if (env_get(env, "turbo") == "on") {
+        fprintf(stderr, "WARNING: turbo is on; clocks vary with temperature and active core count\n");
+    }
+    std::string thp = env_get(env, "thp");
+    if (thp == "never") {
+        fprintf(stderr, "WARNING: transparent huge pages disabled; TLB misses lower large-vector bandwidth\n");
+    } else if (thp == "madvise") {
+        fprintf(stderr, "WARNING: transparent huge pages are madvise-only; malloc'd vectors use 4K pages\n");
+    }
+    if (env_get(env, "numa_balancing") == "1") {
+        fprintf(stderr, "WARNING: automatic NUMA balancing is on; pages may migrate during measurement\n");
+    }
+    std::string quota = env_get(env, "cpu_quota");
+    if (quota != "max" && quota != "n/a" && atof(quota.c_str()) < atof(env_get(env, "cpuset_cpus").c_str())) {
+        fprintf(stderr, "WARNING: CPU quota is %s CPUs of %s visible; larger OpenMP teams get throttled\n",
+                quota.c_str(), env_get(env, "cpuset_cpus").c_str());
+    }
+    if (env_get(env, "smt") == "on") {
+        fprintf(stderr, "WARNING: SMT is on; threads beyond the physical core count share core bandwidth\n");
+    }
+}
+
+// Warn about keys whose values differ between two records (e.g. baseline vs current run).
+// Keys only one record has (ocl_* of a run with OpenCL against one without) are not compared.
+static inline int env_diff(const BenchEnv *a, const BenchEnv *b) {
+    int differences = 0;
+    for (const auto &item : a->items) {
+        bool shared = false;
+        for (const auto &other_item : b->items) {
+            shared = shared || other_item.first == item.first;
+        }
+        std::string other = env_get(b, item.first.c_str());
+        if (shared && other != item.second) {
+            fprintf(stderr, "WARNING: %s differs: %s vs %s\n", item.first.c_str(), item.second.c_str(), other.c_str());
+            differences++;
+        }
+    }
+    return differences;
+}
@@ -0,0 +1,226 @@
+// Small statistics helpers shared by the benchmark tools
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Deterministic xorshift generator so bootstrap results are reproducible
+static inline uint64_t stats_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Linear-interpolated percentile (p in [0, 100]) of an already sorted sample
+static inline double percentile_sorted(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return NAN;
+    }
+    double pos = (p / 100.0) * (sorted.size() - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    double frac = pos - lo;
+    return sorted[lo] * (1.0 - frac) + sorted[hi] * frac;
+}
+
+// Percentile of an unsorted sample (the sample is copied)
+static inline double percentile(std::vector<double> v, double p) {
+    std::sort(v.begin(), v.end());
+    return percentile_sorted(v, p);
+}
+
+// Median of an unsorted sample
+static inline double median(const std::vector<double> &v) {
+    return percentile(v, 50.0);
+}
+
+// Median absolute deviation (unscaled) around the median
+static inline double mad(const std::vector<double> &v) {
+    double m = median(v);
+    std::vector<double> dev(v.size());
+    for (size_t i = 0; i < v.size(); i++) {
+        dev[i] = fabs(v[i] - m);
+    }
+    return median(dev);
+}
+
+// Bootstrap confidence interval for median(b) - median(a).
+// Each resample draws len(a) values from a and len(b) values from b with replacement.
+static inline void bootstrap_median_diff_ci(const std::vector<double> &a, const std::vector<double> &b,
+                                            int resamples, double confidence, double *lo, double *hi) {
+    uint64_t state = 0x9e3779b97f4a7c15ULL; // Fixed seed: same data gives the same interval
+    std::vector<double> diffs(resamples);
+    std::vector<double> ra(a.size()), rb(b.size());
+
+    for (int r = 0; r < resamples; r++) {
+        for (size_t i = 0; i < a.size(); i++) {
+            ra[i] = a[stats_rand(&state) % a.size()];
+        }
+        for (size_t i = 0; i < b.size(); i++) {
+            rb[i] = b[stats_rand(&state) % b.size()];
+        }
+        diffs[r] = median(rb) - median(ra);
+    }
+
+    // Percentile interval of the bootstrap distribution
+    std::sort(diffs.begin(), diffs.end());
+    double tail = (1.0 - confidence) / 2.0 * 100.0;
+    *lo = percentile_sorted(diffs, tail);
+    *hi = percentile_sorted(diffs, 100.0 - tail);
+}
+
+// Distribution-free confidence interval of the median from order statistics
+// (normal approximation to the binomial ranks; needs about 6+ samples to be meaningful)
+static inline void median_ci_sorted(const std::vector<double> &sorted, double z, double *lo, double *hi) {
+    double n = (double)sorted.size();
+    long j = (long)floor(n / 2.0 - z * sqrt(n) / 2.0);
+    long k = (long)ceil(n / 2.0 + z * sqrt(n) / 2.0);
+    j = std::max(j, 0L);
+    k = std::min(k, (long)sorted.size() - 1);
+    *lo = sorted[j];
+    *hi = sorted[k];
+}
+
+// Drop samples whose modified z-score 0.6745 * |x - median| / MAD exceeds 3.5 (Iglewicz-Hoaglin).
+// Returns the number of samples dropped; nothing is dropped when MAD is zero.
+static inline int reject_outliers(const std::vector<double> &in, std::vector<double> &out) {
+    double m = median(in);
+    double d = mad(in);
+    out.clear();
+    for (double x : in) {
+        if (d == 0 || 0.6745 * fabs(x - m) / d <= 3.5) {
+            out.push_back(x);
+        }
+    }
+    return (int)(in.size() - out.size());
+}
+
+// Latency histogram with log-linear buckets: 16 per power of two, so every bucket is within
+// about 6% of the values it holds, from 1 us to hours in a few hundred counters
+#define HIST_SUB 16
+
+struct LatencyHistogram {
+    std::vector<long> counts;
+    long total;
+    long max_us;
+};
+
+// Bucket of a value in microseconds
+static inline int hist_bucket(long us) {
+    if (us < HIST_SUB) {
+        return us < 0 ? 0 : (int)us;
+    }
+    int e = 63 - __builtin_clzll((unsigned long long)us) - 4; // us >> e is in [16, 32)
+    return HIST_SUB + e * HIST_SUB + (int)((us >> e) - HIST_SUB);
+}
+
+// Smallest value in a bucket
+static inline long hist_bucket_low(int b) {
+    if (b < HIST_SUB) {
+        return b;
+    }
+    int e = b / HIST_SUB - 1;
+    return (long)(HIST_SUB + b % HIST_SUB) << e;
+}
+
+static inline void hist_init(LatencyHistogram *h) {
+    h->counts.assign(hist_bucket(1L << 40), 0);
+    h->total = 0;
+    h->max_us = 0;
+}
+
+static inline void hist_record(LatencyHistogram *h, long us) {
+    int b = std::min(hist_bucket(us), (int)h->counts.size() - 1);
+    h->counts[b]++;
+    h->total++;
+    h->max_us = std::max(h->max_us, us);
+}
+
+// Value at percentile p (upper edge of the bucket it falls in, capped at the maximum)
+static inline long hist_percentile(const LatencyHistogram *h, double p) {
+    long rank = (long)ceil(p / 100.0 * h->total);
+    long seen = 0;
+    for (size_t b = 0; b < h->counts.size(); b++) {
+        seen += h->counts[b];
+        if (seen >= rank && h->counts[b] > 0) {
+            return std::min(hist_bucket_low(b + 1) - 1, h->max_us);
+        }
+    }
+    return h->max_us;
+}
+
+// Non-empty buckets with their counts and cumulative share
+static inline void hist_print(const LatencyHistogram *h, FILE *out) {
+    long seen = 0;
+    fprintf(out, "%12s %12s %10s %9s\n", "from_us", "to_us", "count", "cumul%");
+    for (size_t b = 0; b < h->counts.size(); b++) {
+        if (h->counts[b] == 0) {
+            continue;
+        }
+        seen += h->counts[b];
+        fprintf(out, "%12ld %12ld %10ld %9.3f\n", hist_bucket_low(b), hist_bucket_low(b + 1) - 1, h->counts[b],
+                100.0 * seen / h->total);
+    }
+}
+
+// Stopping rule for adaptive repetition
+struct AdaptiveConfig {
+    int min_reps;          // Always take at least this many samples
+    int max_reps;          // Never take more than this many samples
+    double target_rel_ci;  // Stop once the 95% CI of the median is this narrow relative to it
+    double budget_s;       // Or once this much wall time has been spent
+};
+
+// Outcome of an adaptive measurement (times in the unit run_once reports)
+struct AdaptiveResult {
+    double median;
+    double mad;
+    double ci_lo;
+    double ci_hi;
+    int reps;       // Samples taken
+    int outliers;   // Samples discarded as outliers
+    bool converged; // True if the CI target was met before the budget ran out
+};
+
+// Repeat run_once (which returns one time sample) until the CI of the median of the
+// outlier-filtered samples is within the target relative width or the budget is exhausted
+template <typename F>
+AdaptiveResult measure_adaptive(F run_once, const AdaptiveConfig &cfg) {
+    std::vector<double> samples, kept, sorted;
+    AdaptiveResult r = {NAN, NAN, NAN, NAN, 0, 0, false};
+    auto start = std::chrono::steady_clock::now();
+
+    while ((int)samples.size() < cfg.max_reps) {
+        samples.push_back(run_once());
+
+        if ((int)samples.size() < cfg.min_reps) {
+            continue;
+        }
+
+        // Re-evaluate the interval on the filtered sample after every repetition
+        r.outliers = reject_outliers(samples, kept);
+        sorted = kept;
+        std::sort(sorted.begin(), sorted.end());
+        r.median = percentile_sorted(sorted, 50);
+        median_ci_sorted(sorted, 1.96, &r.ci_lo, &r.ci_hi);
+        if ((r.ci_hi - r.ci_lo) <= cfg.target_rel_ci * r.median) {
+            r.converged = true;
+            break;
+        }
+        std::chrono::duration<double> spent = std::chrono::steady_clock::now() - start;
+        if (spent.count() >= cfg.budget_s) {
+            break;
+        }
+    }
+
+    r.reps = (int)samples.size();
+    r.mad = mad(kept);
+    return r;
+}
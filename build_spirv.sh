@@ -0,0 +1,26 @@
+#!/bin/sh
+# Offline build of the OpenCL kernels to SPIR-V, one module per element type.
+#
+# Usage: ./build_spirv.sh [types...]   (default: int float double)
+#
+# Produces vector_ops_ocl.<type>.spv next to vector_ops_ocl.cl. build_program() loads these
+# with clCreateProgramWithIL on devices that report SPIR-V in CL_DEVICE_IL_VERSION and falls
+# back to compiling the source otherwise, so the modules can be shipped alongside the binaries.
+# Needs clang with the SPIR target and llvm-spirv (SPIRV-LLVM-Translator); CLANG and
+# LLVM_SPIRV override the tool names.
+set -e
+
+CLANG=${CLANG:-clang}
+LLVM_SPIRV=${LLVM_SPIRV:-llvm-spirv}
+SRC=vector_ops_ocl.cl
+TYPES=${*:-"int float double"}
+
+cd "$(dirname "$0")"
+for type in $TYPES; do
+    # OpenCL C -> LLVM bitcode for the generic SPIR target, then bitcode -> SPIR-V
+    "$CLANG" -cl-std=CL2.0 -target spir64 -O2 -emit-llvm -c -DT="$type" \
+        -o "vector_ops_ocl.$type.bc" "$SRC"
+    "$LLVM_SPIRV" "vector_ops_ocl.$type.bc" -o "vector_ops_ocl.$type.spv"
+    rm -f "vector_ops_ocl.$type.bc"
+    echo "vector_ops_ocl.$type.spv"
+done
@@ -0,0 +1,191 @@
+// CPU and memory limits of the container (cgroup) this process runs in.
+//
+// OpenMP sizes its team from the CPUs it can see, which inside a container is often every
+// host core even when the cgroup grants a CFS quota of a few CPUs; a team larger than the
+// quota burns the quota early in each period and is throttled for the rest, so a parallel
+// loop stalls until the next period. Likewise /proc/meminfo shows host memory, not the
+// cgroup's memory.max, past which the process is OOM-killed instead of failing an allocation.
+//
+// cgroup_detect() reads both cgroup versions:
+//   v2  cpu.max, memory.max, memory.current
+//   v1  cpu.cfs_quota_us / cpu.cfs_period_us, memory.limit_in_bytes, memory.usage_in_bytes
+// taking the tightest limit of the process's cgroup and its ancestors (limits nest), and the
+// cpuset through the affinity mask. cgroup_apply_omp() sizes the default OpenMP team to what
+// the limits allow; everything sized from omp_get_max_threads() (the worker pool, the engine's
+// variants, per-thread chunks of the static split) follows.
+#pragma once
+
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <omp.h> // For the default team size
+
+#ifndef CGROUP_ROOT
+#define CGROUP_ROOT "/sys/fs/cgroup" // Where the cgroup filesystem is mounted
+#endif
+
+// What the container allows; 0 or less means no limit
+struct CgroupLimits {
+    int version;        // 1 or 2; 0 if no cgroup filesystem was found
+    double cpu_quota;   // CPUs' worth of CFS quota per period
+    int cpuset_cpus;    // CPUs in the affinity mask (cpuset, taskset)
+    long memory_limit;  // Bytes
+    long memory_usage;  // Bytes charged to the cgroup now
+};
+
+// Path of this process's cgroup for a v1 controller, or the v2 path if controller is NULL
+static inline std::string cgroup_path(const char *controller) {
+    std::string path;
+    char line[1024];
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (f == NULL) {
+        return path;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char *list = strchr(line, ':');
+        char *p = list != NULL ? strchr(list + 1, ':') : NULL;
+        if (p == NULL) {
+            continue;
+        }
+        *p = '\0';
+        std::string controllers = std::string(",") + (list + 1) + ",";
+        bool match = controller == NULL ? controllers == ",," : controllers.find(std::string(",") + controller + ",") != std::string::npos;
+        if (match) {
+            path = p + 1;
+            break;
+        }
+    }
+    fclose(f);
+    return path == "/" ? "" : path;
+}
+
+// Tightest value of file in the cgroup at dir + path and its ancestors; limit(dir) reads one
+// level and returns -1 for no limit. Containers that see their own cgroup as the mount root
+// skip the levels that do not exist.
+template <typename F>
+static inline double cgroup_tightest(const std::string &dir, std::string path, F limit) {
+    double best = -1;
+    while (true) {
+        double v = limit(dir + path);
+        if (v > 0 && (best < 0 || v < best)) {
+            best = v;
+        }
+        if (path.empty()) {
+            return best;
+        }
+        path = path.substr(0, path.rfind('/'));
+    }
+}
+
+// First line of a cgroup file, or "" if it cannot be read
+static inline std::string cgroup_read_line(const std::string &file) {
+    char buf[256] = "";
+    FILE *f = fopen(file.c_str(), "r");
+    if (f == NULL) {
+        return "";
+    }
+    if (fgets(buf, sizeof(buf), f) == NULL) {
+        buf[0] = '\0';
+    }
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return buf;
+}
+
+// Number in a cgroup file, or -1 if the file is missing or says "max"
+static inline double cgroup_read_number(const std::string &file) {
+    std::string line = cgroup_read_line(file);
+    return line.empty() || line == "max" ? -1 : atof(line.c_str());
+}
+
+// Read the limits of this process's cgroup
+static inline void cgroup_detect(CgroupLimits *c) {
+    c->version = 0;
+    c->cpu_quota = -1;
+    c->memory_limit = -1;
+    c->memory_usage = -1;
+    cpu_set_t set;
+    c->cpuset_cpus = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (access(CGROUP_ROOT "/cgroup.controllers", F_OK) == 0) {
+        // v2: one hierarchy; cpu.max is "<quota> <period>" or "max <period>"
+        c->version = 2;
+        std::string path = cgroup_path(NULL);
+        c->cpu_quota = cgroup_tightest(CGROUP_ROOT, path, [](const std::string &dir) {
+            double quota = -1, period = 0;
+            std::string line = cgroup_read_line(dir + "/cpu.max");
+            if (sscanf(line.c_str(), "%lf %lf", &quota, &period) != 2 || period <= 0) {
+                return -1.0;
+            }
+            return quota / period;
+        });
+        c->memory_limit = (long)cgroup_tightest(CGROUP_ROOT, path, [](const std::string &dir) {
+            return cgroup_read_number(dir + "/memory.max");
+        });
+        c->memory_usage = (long)cgroup_read_number(CGROUP_ROOT + path + "/memory.current");
+        if (c->memory_usage < 0) {
+            c->memory_usage = (long)cgroup_read_number(CGROUP_ROOT "/memory.current");
+        }
+        return;
+    }
+
+    // v1: one hierarchy per controller; a quota of -1 and limits near 2^63 mean none
+    std::string cpu_dir = access(CGROUP_ROOT "/cpu,cpuacct", F_OK) == 0 ? CGROUP_ROOT "/cpu,cpuacct" : CGROUP_ROOT "/cpu";
+    if (access(cpu_dir.c_str(), F_OK) == 0) {
+        c->version = 1;
+        c->cpu_quota = cgroup_tightest(cpu_dir, cgroup_path("cpu"), [](const std::string &dir) {
+            double quota = cgroup_read_number(dir + "/cpu.cfs_quota_us");
+            double period = cgroup_read_number(dir + "/cpu.cfs_period_us");
+            return quota > 0 && period > 0 ? quota / period : -1.0;
+        });
+    }
+    std::string mem_dir = CGROUP_ROOT "/memory";
+    if (access(mem_dir.c_str(), F_OK) == 0) {
+        c->version = 1;
+        std::string path = cgroup_path("memory");
+        c->memory_limit = (long)cgroup_tightest(mem_dir, path, [](const std::string &dir) {
+            double limit = cgroup_read_number(dir + "/memory.limit_in_bytes");
+            return limit >= (double)(1L << 62) ? -1.0 : limit;
+        });
+        c->memory_usage = (long)cgroup_read_number(mem_dir + path + "/memory.usage_in_bytes");
+        if (c->memory_usage < 0) {
+            c->memory_usage = (long)cgroup_read_number(mem_dir + "/memory.usage_in_bytes");
+        }
+    }
+}
+
+// Threads that can run at once without being throttled: the cpuset, cut to the whole CPUs of
+// the quota (at least one)
+static inline int cgroup_cpu_limit(const CgroupLimits *c) {
+    int cpus = c->cpuset_cpus > 0 ? c->cpuset_cpus : 1;
+    if (c->cpu_quota > 0) {
+        int quota = (int)floor(c->cpu_quota);
+        cpus = quota < 1 ? 1 : (quota < cpus ? quota : cpus);
+    }
+    return cpus;
+}
+
+// Bytes the cgroup can still charge before its limit, or -1 without a limit
+static inline long cgroup_memory_headroom(const CgroupLimits *c) {
+    if (c->memory_limit <= 0) {
+        return -1;
+    }
+    long headroom = c->memory_limit - (c->memory_usage > 0 ? c->memory_usage : 0);
+    return headroom > 0 ? headroom : 0;
+}
+
+// Size the default OpenMP team to the cgroup's CPU limit unless OMP_NUM_THREADS is set;
+// returns the team size in effect. OpenMP keeps the setting per thread: call it from the
+// thread that starts the parallel regions, before it starts them.
+static inline int cgroup_apply_omp(const CgroupLimits *c) {
+    int limit = cgroup_cpu_limit(c);
+    if (getenv("OMP_NUM_THREADS") == NULL && limit < omp_get_max_threads()) {
+        omp_set_num_threads(limit);
+    }
+    return omp_get_max_threads();
+}
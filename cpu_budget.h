@@ -0,0 +1,65 @@
+// CPU budget for processes that run an OpenMP team and an OpenCL CPU device at the same time
+// (co-execution, or host work pipelined with kernels).
+//
+// Each runtime sizes its thread pool to every core, so uncoordinated they put two busy threads
+// on each core and lose time to context switches and cache thrashing. cpu_budget_plan() splits
+// the CPUs this process may use; the OpenMP side then runs with omp_threads threads and the
+// OpenCL side is limited to ocl_units compute units, either by
+//   - device fission: cpu_budget_subdevice() partitions the device with clCreateSubDevices, or
+//   - runtime thread limits: cpu_budget_limit_opencl() sets the variables the CPU runtimes
+//     read at startup (pocl). This must run before OpenCL is loaded, i.e. before the first
+//     create_device() / list_devices() (ocl_loader.h loads lazily).
+#pragma once
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cgroup_limits.h"
+#include "ocl_common.h"
+
+// How the CPUs are shared
+struct CpuBudget {
+    int total;       // CPUs in the affinity mask, cut to the cgroup CPU quota
+    int omp_threads; // OpenMP team size
+    int ocl_units;   // OpenCL compute units
+};
+
+// Give ocl_share of the CPUs (at least one) to OpenCL and the rest (at least one) to OpenMP
+static inline void cpu_budget_plan(CpuBudget *b, double ocl_share) {
+    CgroupLimits cg;
+    cgroup_detect(&cg);
+    b->total = cgroup_cpu_limit(&cg);
+    b->ocl_units = (int)(b->total * ocl_share + 0.5);
+    b->ocl_units = b->ocl_units < 1 ? 1 : b->ocl_units;
+    b->omp_threads = b->total - b->ocl_units;
+    b->omp_threads = b->omp_threads < 1 ? 1 : b->omp_threads;
+}
+
+// Limit the OpenCL CPU runtime's worker threads to ocl_units; call before OpenCL is loaded
+static inline void cpu_budget_limit_opencl(const CpuBudget *b) {
+    if (ocl_startup.loaded) {
+        fprintf(stderr, "WARNING: OpenCL already loaded; its thread limit will not change\n");
+    }
+    char units[16];
+    snprintf(units, sizeof(units), "%d", b->ocl_units);
+    setenv("POCL_MAX_PTHREAD_COUNT", units, 1); // pocl pthread device
+    setenv("POCL_CPU_MAX_CU_COUNT", units, 1);  // pocl cpu device (1.8+)
+}
+
+// Sub-device of dev with the given number of compute units (device fission), or NULL if the
+// device cannot be partitioned that way. Release with clReleaseDevice.
+static inline cl_device_id cpu_budget_subdevice(cl_device_id dev, int units) {
+    cl_uint max_sub = 0;
+    clGetDeviceInfo(dev, CL_DEVICE_PARTITION_MAX_SUB_DEVICES, sizeof(max_sub), &max_sub, NULL);
+    if (max_sub < 2) {
+        return NULL;
+    }
+    cl_device_partition_property props[] = {CL_DEVICE_PARTITION_BY_COUNTS, units,
+                                            CL_DEVICE_PARTITION_BY_COUNTS_LIST_END, 0};
+    cl_device_id sub;
+    cl_uint count = 0;
+    if (clCreateSubDevices(dev, props, 1, &sub, &count) < 0 || count == 0) {
+        return NULL;
+    }
+    return sub;
+}
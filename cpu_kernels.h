@@ -0,0 +1,305 @@
+// Family of CPU vector add inner loops and an autotuner that picks the fastest per size class.
+//
+// Variants are generated from one template per instruction set (SSE2, AVX2, AVX-512) over
+// unroll factor (1, 2, 4, 8 vectors per iteration), software prefetch (on/off) and store type
+// (regular or non-temporal). The plain loop the compiler generates is kept as "baseline".
+// Winners are recorded per size class in vector_add_tune.<hostname>.txt.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#include <omp.h> // For OpenMP multi-threading
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_KERNELS_X86 1
+#endif
+#include "bench_stats.h"
+
+#define CPU_PREFETCH_DISTANCE 1024 // Elements ahead of the current position to prefetch
+
+// Inner loop over n elements; pointers may have any alignment
+typedef void (*cpu_add_fn)(const int *v1, const int *v2, int *v_out, long n);
+
+// One variant of the family
+struct CpuKernel {
+    const char *isa;   // "baseline", "sse2", "avx2" or "avx512"
+    int unroll;        // Vectors per loop iteration
+    bool prefetch;     // Software prefetch of the inputs
+    bool nt;           // Non-temporal stores for the output
+    cpu_add_fn fn;
+};
+
+// The loop the compiler generates for the original code
+static void cpu_add_baseline(const int *v1, const int *v2, int *v_out, long n) {
+    for (long i = 0; i < n; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+}
+
+#ifdef CPU_KERNELS_X86
+// Prefetch the input cache lines one iteration of span elements will read, DISTANCE ahead
+#define CPU_PREFETCH_INPUTS(i, span)                                                        \
+    for (int off = 0; off < (span); off += 16) {                                            \
+        _mm_prefetch((const char *)(v1 + (i) + CPU_PREFETCH_DISTANCE + off), _MM_HINT_T0);  \
+        _mm_prefetch((const char *)(v2 + (i) + CPU_PREFETCH_DISTANCE + off), _MM_HINT_T0);  \
+    }
+
+// Scalar head so non-temporal stores start on a vector-aligned address
+#define CPU_ALIGN_OUTPUT(bytes)                                           \
+    while (NT && i < n && ((uintptr_t)(v_out + i) & ((bytes) - 1)) != 0) { \
+        v_out[i] = v1[i] + v2[i];                                         \
+        i++;                                                              \
+    }
+
+template <int U, bool PF, bool NT>
+__attribute__((target("sse2"))) void cpu_add_sse2(const int *v1, const int *v2, int *v_out, long n) {
+    long i = 0;
+    CPU_ALIGN_OUTPUT(16)
+    for (; i + 4 * U <= n; i += 4 * U) {
+        if (PF) {
+            CPU_PREFETCH_INPUTS(i, 4 * U)
+        }
+        for (int u = 0; u < U; u++) {
+            __m128i s = _mm_add_epi32(_mm_loadu_si128((const __m128i *)(v1 + i + 4 * u)),
+                                      _mm_loadu_si128((const __m128i *)(v2 + i + 4 * u)));
+            if (NT) {
+                _mm_stream_si128((__m128i *)(v_out + i + 4 * u), s);
+            } else {
+                _mm_storeu_si128((__m128i *)(v_out + i + 4 * u), s);
+            }
+        }
+    }
+    for (; i < n; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+    if (NT) {
+        _mm_sfence();
+    }
+}
+
+template <int U, bool PF, bool NT>
+__attribute__((target("avx2"))) void cpu_add_avx2(const int *v1, const int *v2, int *v_out, long n) {
+    long i = 0;
+    CPU_ALIGN_OUTPUT(32)
+    for (; i + 8 * U <= n; i += 8 * U) {
+        if (PF) {
+            CPU_PREFETCH_INPUTS(i, 8 * U)
+        }
+        for (int u = 0; u < U; u++) {
+            __m256i s = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(v1 + i + 8 * u)),
+                                         _mm256_loadu_si256((const __m256i *)(v2 + i + 8 * u)));
+            if (NT) {
+                _mm256_stream_si256((__m256i *)(v_out + i + 8 * u), s);
+            } else {
+                _mm256_storeu_si256((__m256i *)(v_out + i + 8 * u), s);
+            }
+        }
+    }
+    for (; i < n; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+    if (NT) {
+        _mm_sfence();
+    }
+}
+
+template <int U, bool PF, bool NT>
+__attribute__((target("avx512f"))) void cpu_add_avx512(const int *v1, const int *v2, int *v_out, long n) {
+    long i = 0;
+    CPU_ALIGN_OUTPUT(64)
+    for (; i + 16 * U <= n; i += 16 * U) {
+        if (PF) {
+            CPU_PREFETCH_INPUTS(i, 16 * U)
+        }
+        for (int u = 0; u < U; u++) {
+            __m512i s = _mm512_add_epi32(_mm512_loadu_si512(v1 + i + 16 * u), _mm512_loadu_si512(v2 + i + 16 * u));
+            if (NT) {
+                _mm512_stream_si512((__m512i *)(v_out + i + 16 * u), s);
+            } else {
+                _mm512_storeu_si512(v_out + i + 16 * u, s);
+            }
+        }
+    }
+    for (; i < n; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+    if (NT) {
+        _mm_sfence();
+    }
+}
+
+// All prefetch/store combinations of one unroll factor, then all unroll factors of one ISA
+#define CPU_KERNELS_UNROLL(isa, fn, U)                                                    \
+    {isa, U, false, false, fn<U, false, false>}, {isa, U, false, true, fn<U, false, true>}, \
+    {isa, U, true, false, fn<U, true, false>}, {isa, U, true, true, fn<U, true, true>}
+#define CPU_KERNELS_ISA(isa, fn) \
+    CPU_KERNELS_UNROLL(isa, fn, 1), CPU_KERNELS_UNROLL(isa, fn, 2), CPU_KERNELS_UNROLL(isa, fn, 4), CPU_KERNELS_UNROLL(isa, fn, 8)
+#endif
+
+// Every generated variant; entries for ISAs the CPU lacks are skipped at runtime
+static const CpuKernel CPU_KERNELS[] = {
+    {"baseline", 1, false, false, cpu_add_baseline},
+#ifdef CPU_KERNELS_X86
+    CPU_KERNELS_ISA("sse2", cpu_add_sse2),
+    CPU_KERNELS_ISA("avx2", cpu_add_avx2),
+    CPU_KERNELS_ISA("avx512", cpu_add_avx512),
+#endif
+};
+#define NUM_CPU_KERNELS (int)(sizeof(CPU_KERNELS) / sizeof(CPU_KERNELS[0]))
+
+// Upper bound (elements) of each tuned size class: roughly L1, L2, last-level cache, DRAM
+const long CPU_SIZE_CLASSES[] = {2048, 32768, 524288, 1L << 62};
+#define NUM_CPU_SIZE_CLASSES (int)(sizeof(CPU_SIZE_CLASSES) / sizeof(CPU_SIZE_CLASSES[0]))
+
+// Tuned kernel per size class (NULL until cpu_tuning_load or cpu_autotune fills it)
+static const CpuKernel *CPU_TUNED[NUM_CPU_SIZE_CLASSES];
+
+// Printable variant name, e.g. "avx2-u4-pf-nt"
+static inline const char *cpu_kernel_name(const CpuKernel *k, char *buf, size_t len) {
+    snprintf(buf, len, "%s-u%d%s%s", k->isa, k->unroll, k->prefetch ? "-pf" : "", k->nt ? "-nt" : "");
+    return buf;
+}
+
+// True if this CPU can run the variant
+static inline bool cpu_kernel_supported(const CpuKernel *k) {
+#ifdef CPU_KERNELS_X86
+    if (strcmp(k->isa, "sse2") == 0) return __builtin_cpu_supports("sse2");
+    if (strcmp(k->isa, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    if (strcmp(k->isa, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+#endif
+    return strcmp(k->isa, "baseline") == 0;
+}
+
+// Run a variant over the whole vector with the current OpenMP team, split statically.
+// Split points are multiples of 16 elements so every thread's output starts cache-line aligned
+// whenever v_out itself is.
+static inline void cpu_add_parallel(const CpuKernel *k, const int *v1, const int *v2, int *v_out, long size) {
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int n = omp_get_num_threads();
+        long lo = (size * t / n) & ~15L;
+        long hi = t == n - 1 ? size : (size * (t + 1) / n) & ~15L;
+        k->fn(v1 + lo, v2 + lo, v_out + lo, hi - lo);
+    }
+}
+
+// Tuned kernel for a vector of this size, or NULL if this host has not been tuned
+static inline const CpuKernel *cpu_kernel_for_size(long size) {
+    for (int c = 0; c < NUM_CPU_SIZE_CLASSES; c++) {
+        if (size <= CPU_SIZE_CLASSES[c]) {
+            return CPU_TUNED[c];
+        }
+    }
+    return NULL;
+}
+
+// Default tuning file name for this host
+static inline void cpu_tuning_path(char *buf, size_t len) {
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    snprintf(buf, len, "vector_add_tune.%s.txt", host);
+}
+
+// Load winners from a tuning file ("class_max_elems variant_name" per line); false if absent
+static inline bool cpu_tuning_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char line[256], want[64], name[64];
+    long max_elems;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%ld %63s", &max_elems, want) != 2) {
+            continue;
+        }
+        for (int c = 0; c < NUM_CPU_SIZE_CLASSES; c++) {
+            if (CPU_SIZE_CLASSES[c] != max_elems) {
+                continue;
+            }
+            for (int k = 0; k < NUM_CPU_KERNELS; k++) {
+                if (strcmp(cpu_kernel_name(&CPU_KERNELS[k], name, sizeof(name)), want) == 0 &&
+                    cpu_kernel_supported(&CPU_KERNELS[k])) {
+                    CPU_TUNED[c] = &CPU_KERNELS[k];
+                }
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// Search every supported variant for each size class and write the winners to path.
+// Small classes repeat the add inside one sample so each sample lasts long enough to time.
+static inline void cpu_autotune(const char *path, const AdaptiveConfig &cfg, FILE *log) {
+    const long test_sizes[NUM_CPU_SIZE_CLASSES] = {2048, 32768, 524288, 1L << 25};
+    char name[64];
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Couldn't write the tuning file");
+        exit(1);
+    }
+    fprintf(f, "# class_max_elems variant (threads=%d)\n", omp_get_max_threads());
+
+    for (int c = 0; c < NUM_CPU_SIZE_CLASSES; c++) {
+        long size = test_sizes[c];
+        int inner = (int)(size >= (1 << 22) ? 1 : (1 << 22) / size); // ~4M elements per sample
+        int *v1 = (int *)malloc(sizeof(int) * size);
+        int *v2 = (int *)malloc(sizeof(int) * size);
+        int *v_out = (int *)malloc(sizeof(int) * size);
+        for (long i = 0; i < size; i++) {
+            v1[i] = rand() % 100;
+            v2[i] = rand() % 100;
+        }
+
+        const CpuKernel *best = NULL;
+        double best_ns = 0;
+        for (int k = 0; k < NUM_CPU_KERNELS; k++) {
+            const CpuKernel *kern = &CPU_KERNELS[k];
+            if (!cpu_kernel_supported(kern)) {
+                continue;
+            }
+            // Warm up and check every element: variants differ exactly at the per-thread split
+            // points, alignment heads and unroll remainders, so the ends alone prove nothing
+            memset(v_out, 0xff, sizeof(int) * size);
+            cpu_add_parallel(kern, v1, v2, v_out, size);
+            for (long i = 0; i < size; i++) {
+                if (v_out[i] != v1[i] + v2[i]) {
+                    printf("Variant %s produced a wrong result at element %ld\n", cpu_kernel_name(kern, name, sizeof(name)), i);
+                    exit(1);
+                }
+            }
+            AdaptiveResult r = measure_adaptive([&]() {
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int rep = 0; rep < inner; rep++) {
+                    cpu_add_parallel(kern, v1, v2, v_out, size);
+                }
+                auto stop = std::chrono::high_resolution_clock::now();
+                return std::chrono::duration<double, std::nano>(stop - start).count() / ((double)inner * size);
+            }, cfg);
+            if (log != NULL) {
+                fprintf(log, "n=%-9ld %-20s %8.3f GB/s  (%d reps)\n", size, cpu_kernel_name(kern, name, sizeof(name)),
+                        3 * sizeof(int) / r.median, r.reps);
+            }
+            if (best == NULL || r.median < best_ns) {
+                best = kern;
+                best_ns = r.median;
+            }
+        }
+
+        CPU_TUNED[c] = best;
+        fprintf(f, "%ld %s\n", CPU_SIZE_CLASSES[c], cpu_kernel_name(best, name, sizeof(name)));
+        if (log != NULL) {
+            fprintf(log, "size class <= %ld: winner %s (%.3f GB/s)\n", CPU_SIZE_CLASSES[c], name, 3 * sizeof(int) / best_ns);
+        }
+        free(v1);
+        free(v2);
+        free(v_out);
+    }
+    fclose(f);
+}
@@ -0,0 +1,205 @@
+// NUMA placement for vectors whose pages were not first-touched by the worker threads
+// (e.g. filled by one thread, read from an mmap'd file, or handed over by another process).
+//
+// Policies, applied to page-aligned mmap allocations before the data is written:
+//   firsttouch  leave placement to the kernel (pages land where they are first written)
+//   interleave  spread pages round-robin over all nodes (mbind MPOL_INTERLEAVE)
+//   bind        bind each thread's static chunk to that thread's node (mbind MPOL_BIND)
+// numa_migrate_chunks() moves the pages of existing data to the node of the thread that will
+// process them (move_pages), for data that is already in place, and counts only the pages the
+// kernel reports as moved. Link with -lnuma.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#include <numa.h>
+#include <numaif.h>
+#include <omp.h> // For OpenMP multi-threading
+
+enum NumaPolicy { NUMA_FIRSTTOUCH, NUMA_INTERLEAVE, NUMA_BIND };
+
+// Elements [lo, hi) thread t of n works on; every NUMA-aware loop uses this same split
+static inline void numa_chunk(long size, int t, int n, long *lo, long *hi) {
+    *lo = size * t / n;
+    *hi = size * (t + 1) / n;
+}
+
+// Node each OpenMP thread runs on (threads should be pinned, e.g. OMP_PROC_BIND=true)
+static inline std::vector<int> numa_thread_nodes() {
+    std::vector<int> nodes(omp_get_max_threads(), 0);
+    if (omp_get_proc_bind() == omp_proc_bind_false) {
+        fprintf(stderr, "WARNING: OpenMP threads are not pinned (set OMP_PROC_BIND=true); thread nodes may change\n");
+    }
+    #pragma omp parallel
+    {
+        int node = numa_available() < 0 ? 0 : numa_node_of_cpu(sched_getcpu());
+        nodes[omp_get_thread_num()] = node < 0 ? 0 : node;
+    }
+    return nodes;
+}
+
+// Page-aligned range covering [p, p + bytes)
+static inline void numa_page_range(void *p, size_t bytes, char **start, size_t *len) {
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t s = (uintptr_t)p & ~(uintptr_t)(page - 1);
+    uintptr_t e = ((uintptr_t)p + bytes + page - 1) & ~(uintptr_t)(page - 1);
+    *start = (char *)s;
+    *len = e - s;
+}
+
+// Allocate an untouched vector of size ints with the given placement policy
+static inline int *numa_alloc_vector(long size, NumaPolicy policy, const std::vector<int> &thread_nodes) {
+    size_t bytes = size * sizeof(int);
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("Couldn't map vector memory");
+        exit(1);
+    }
+    if (numa_available() < 0 || policy == NUMA_FIRSTTOUCH) {
+        return (int *)p;
+    }
+
+    if (policy == NUMA_INTERLEAVE) {
+        // One mask with every node
+        struct bitmask *all = numa_allocate_nodemask();
+        numa_bitmask_setall(all);
+        if (mbind(p, bytes, MPOL_INTERLEAVE, all->maskp, all->size + 1, 0) != 0) {
+            perror("Couldn't interleave vector memory");
+        }
+        numa_bitmask_free(all);
+    } else {
+        // Bind each thread's chunk to its node; chunk edges share a page with the neighbour,
+        // which then follows the later chunk
+        int n = (int)thread_nodes.size();
+        for (int t = 0; t < n; t++) {
+            long lo, hi;
+            numa_chunk(size, t, n, &lo, &hi);
+            char *start;
+            size_t len;
+            numa_page_range((int *)p + lo, (hi - lo) * sizeof(int), &start, &len);
+            struct bitmask *mask = numa_allocate_nodemask();
+            numa_bitmask_setbit(mask, thread_nodes[t]);
+            if (mbind(start, len, MPOL_BIND, mask->maskp, mask->size + 1, 0) != 0) {
+                perror("Couldn't bind vector chunk");
+            }
+            numa_bitmask_free(mask);
+        }
+    }
+    return (int *)p;
+}
+
+// Release a vector from numa_alloc_vector
+static inline void numa_free_vector(int *p, long size) {
+    munmap(p, size * sizeof(int));
+}
+
+// v_out = v1 + v2 with every thread working on its numa_chunk() range
+static inline void numa_vector_add(const int *v1, const int *v2, int *v_out, long size, int threads) {
+    #pragma omp parallel num_threads(threads)
+    {
+        long lo, hi;
+        numa_chunk(size, omp_get_thread_num(), omp_get_num_threads(), &lo, &hi);
+        for (long i = lo; i < hi; i++) {
+            v_out[i] = v1[i] + v2[i];
+        }
+    }
+}
+
+// Move the pages of each thread's chunk to that thread's node, in parallel.
+// Returns the number of pages the kernel actually moved; *failed gets the pages that were on
+// another node and stayed there (e.g. pages also mapped by another process, which MPOL_MF_MOVE
+// leaves in place, or all of them if move_pages itself failed).
+static inline long numa_migrate_chunks(int *p, long size, const std::vector<int> &thread_nodes, long *failed) {
+    *failed = 0;
+    if (numa_available() < 0) {
+        return 0;
+    }
+    long moved = 0, stayed = 0;
+    int n = (int)thread_nodes.size();
+    long page = sysconf(_SC_PAGESIZE);
+
+    #pragma omp parallel num_threads(n) reduction(+ : moved, stayed)
+    {
+        int t = omp_get_thread_num();
+        long lo, hi;
+        numa_chunk(size, t, n, &lo, &hi);
+        char *start;
+        size_t len;
+        numa_page_range(p + lo, (hi - lo) * sizeof(int), &start, &len);
+
+        // Query current placement, then request the move for pages elsewhere
+        long count = len / page;
+        std::vector<void *> pages(count);
+        std::vector<int> status(count), target;
+        std::vector<void *> to_move;
+        for (long i = 0; i < count; i++) {
+            pages[i] = start + i * page;
+        }
+        move_pages(0, count, pages.data(), NULL, status.data(), 0);
+        for (long i = 0; i < count; i++) {
+            if (status[i] >= 0 && status[i] != thread_nodes[t]) {
+                to_move.push_back(pages[i]);
+                target.push_back(thread_nodes[t]);
+            }
+        }
+        if (!to_move.empty()) {
+            // result[i] is the page's node afterwards, or a negative errno if it was not moved
+            std::vector<int> result(to_move.size(), -1);
+            if (move_pages(0, to_move.size(), to_move.data(), target.data(), result.data(), MPOL_MF_MOVE) < 0) {
+                perror("Couldn't migrate vector pages");
+                result.assign(to_move.size(), -1);
+            }
+            for (size_t i = 0; i < to_move.size(); i++) {
+                if (result[i] == target[i]) {
+                    moved++;
+                } else {
+                    stayed++;
+                }
+            }
+        }
+    }
+    *failed = stayed;
+    return moved;
+}
+
+// Print how many pages of a vector live on each node
+static inline void numa_print_placement(const char *name, int *p, long size) {
+    if (numa_available() < 0) {
+        printf("%s: NUMA not available\n", name);
+        return;
+    }
+    char *start;
+    size_t len;
+    long page = sysconf(_SC_PAGESIZE);
+    numa_page_range(p, size * sizeof(int), &start, &len);
+    long count = len / page;
+    std::vector<void *> pages(count);
+    std::vector<int> status(count);
+    for (long i = 0; i < count; i++) {
+        pages[i] = start + i * page;
+    }
+    move_pages(0, count, pages.data(), NULL, status.data(), 0);
+
+    std::vector<long> per_node(numa_max_node() + 1, 0);
+    long unmapped = 0;
+    for (long i = 0; i < count; i++) {
+        if (status[i] >= 0 && status[i] < (int)per_node.size()) {
+            per_node[status[i]]++;
+        } else {
+            unmapped++;
+        }
+    }
+    printf("%s pages:", name);
+    for (size_t node = 0; node < per_node.size(); node++) {
+        printf(" node%zu=%ld", node, per_node[node]);
+    }
+    if (unmapped > 0) {
+        printf(" not-present=%ld", unmapped);
+    }
+    printf("\n");
+}
@@ -0,0 +1,373 @@
+// OpenCL helpers shared by vector_add_opencl and the benchmark tools.
+// create_device() uses the first platform unless OCL_PLATFORM / OCL_DEVICE (indices as listed
+// by list_devices(), e.g. "vector_add_bench platforms") select another one.
+// The runtime is loaded on first use (ocl_loader.h). Setup failures are reported and returned
+// (NULL / false) so callers can fall back to the CPU path instead of exiting.
+// build_program() prefers the offline-compiled SPIR-V next to the source (build_spirv.sh)
+// when the device accepts SPIR-V; OCL_SPIRV=0 forces compiling from source. A module older
+// than the source, or one missing a kernel the source defines, is skipped for the source.
+#pragma once
+
+#define CL_TARGET_OPENCL_VERSION 200 // Define OpenCL version 2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <CL/cl.h>
+#include "ocl_loader.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include "bench_env.h"
+
+// One device with its context, queue and a built vector_add_ocl kernel
+struct OclBackend {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    double build_ms; // Time build_program() took for this backend
+};
+
+// A device together with its platform and their positions in the enumeration
+struct OclDeviceRef {
+    cl_platform_id platform;
+    cl_device_id device;
+    int platform_index;
+    int device_index;
+};
+
+// Every device of every installed platform, in platform order (empty if OpenCL is unavailable)
+static inline std::vector<OclDeviceRef> list_devices() {
+    std::vector<OclDeviceRef> devices;
+    if (!ocl_load()) {
+        return devices;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    cl_uint num_platforms = 0;
+    if (clGetPlatformIDs(0, NULL, &num_platforms) < 0 || num_platforms == 0) {
+        return devices;
+    }
+    std::vector<cl_platform_id> platforms(num_platforms);
+    clGetPlatformIDs(num_platforms, platforms.data(), NULL);
+
+    for (cl_uint p = 0; p < num_platforms; p++) {
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) < 0 || num_devices == 0) {
+            continue;
+        }
+        std::vector<cl_device_id> ids(num_devices);
+        clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, num_devices, ids.data(), NULL);
+        for (cl_uint d = 0; d < num_devices; d++) {
+            OclDeviceRef ref = {platforms[p], ids[d], (int)p, (int)d};
+            devices.push_back(ref);
+        }
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    ocl_startup.discover_ms += std::chrono::duration<double, std::milli>(stop - start).count();
+    return devices;
+}
+
+// Select a device (prefer GPU, fall back to CPU), or the one named by OCL_PLATFORM / OCL_DEVICE.
+// Returns NULL if OpenCL or a suitable device is not available.
+static inline cl_device_id create_device() {
+    cl_platform_id platform;
+    cl_device_id dev;
+    cl_int err;
+    if (!ocl_load()) {
+        return NULL;
+    }
+
+    // An explicit platform/device index overrides the default choice
+    const char *want_platform = getenv("OCL_PLATFORM");
+    if (want_platform != NULL) {
+        const char *want_device = getenv("OCL_DEVICE");
+        int p = atoi(want_platform);
+        int d = want_device != NULL ? atoi(want_device) : 0;
+        for (const OclDeviceRef &ref : list_devices()) {
+            if (ref.platform_index == p && ref.device_index == d) {
+                return ref.device;
+            }
+        }
+        fprintf(stderr, "No OpenCL device %d on platform %d\n", d, p);
+        return NULL;
+    }
+
+    // Get the first available platform
+    auto start = std::chrono::high_resolution_clock::now();
+    err = clGetPlatformIDs(1, &platform, NULL);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't identify a platform (error %d)\n", err);
+        return NULL;
+    }
+
+    // Try to get a GPU device first
+    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &dev, NULL);
+    if (err == CL_DEVICE_NOT_FOUND) {
+        // If no GPU is available, fall back to CPU
+        printf("GPU not found, falling back to CPU\n");
+        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &dev, NULL);
+    }
+
+    if (err < 0) {
+        fprintf(stderr, "Couldn't access any devices (error %d)\n", err);
+        return NULL;
+    }
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    ocl_startup.discover_ms += std::chrono::duration<double, std::milli>(stop - start).count();
+    return dev;
+}
+
+// Print the build log of a program that failed to build
+static inline void print_build_log(cl_program program, cl_device_id dev) {
+    size_t log_size;
+    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    char *program_log = (char *)malloc(log_size + 1);
+    program_log[log_size] = '\0';
+    clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
+    printf("%s\n", program_log);
+    free(program_log);
+}
+
+// SPIR-V file build_spirv.sh produces for a source file and type: "x.cl" -> "x.<type>.spv"
+static inline std::string spirv_path(const char *filename, const char *type_name) {
+    std::string path = filename;
+    size_t dot = path.rfind(".cl");
+    if (dot != std::string::npos && dot + 3 == path.size()) {
+        path.erase(dot);
+    }
+    return path + "." + (type_name != NULL ? type_name : "int") + ".spv";
+}
+
+// Names of the kernels a source file defines ("__kernel void <name>(")
+static inline std::vector<std::string> source_kernel_names(const char *filename) {
+    std::vector<std::string> names;
+    FILE *handle = fopen(filename, "r");
+    if (handle == NULL) {
+        return names;
+    }
+    char line[512], name[128];
+    while (fgets(line, sizeof(line), handle) != NULL) {
+        if (sscanf(line, " __kernel void %127[A-Za-z0-9_]", name) == 1) {
+            names.push_back(name);
+        }
+    }
+    fclose(handle);
+    return names;
+}
+
+// Build from the offline-compiled SPIR-V if the device, the runtime and the file allow it;
+// NULL means "use the source" (a SPIR-V build failure is reported but not fatal). The module
+// must be at least as new as the source and contain all of its kernels: one built before a
+// kernel was added would otherwise make clCreateKernel fail later with no way back.
+static inline cl_program build_program_il(cl_context ctx, cl_device_id dev, const char *filename, const char *type_name) {
+    const char *use = getenv("OCL_SPIRV");
+    if (clCreateProgramWithIL == NULL || (use != NULL && strcmp(use, "0") == 0)) {
+        return NULL;
+    }
+    char il_version[128] = "";
+    clGetDeviceInfo(dev, CL_DEVICE_IL_VERSION, sizeof(il_version), il_version, NULL);
+    if (strstr(il_version, "SPIR-V") == NULL) {
+        return NULL;
+    }
+
+    // Read the module unless the source changed after it was built
+    std::string path = spirv_path(filename, type_name);
+    struct stat il_stat, source_stat;
+    if (stat(path.c_str(), &il_stat) != 0) {
+        return NULL;
+    }
+    if (stat(filename, &source_stat) == 0 &&
+        (il_stat.st_mtim.tv_sec < source_stat.st_mtim.tv_sec ||
+         (il_stat.st_mtim.tv_sec == source_stat.st_mtim.tv_sec && il_stat.st_mtim.tv_nsec < source_stat.st_mtim.tv_nsec))) {
+        fprintf(stderr, "%s is older than %s, using source (rerun build_spirv.sh)\n", path.c_str(), filename);
+        return NULL;
+    }
+    FILE *handle = fopen(path.c_str(), "rb");
+    if (handle == NULL) {
+        return NULL;
+    }
+    fseek(handle, 0, SEEK_END);
+    size_t il_size = ftell(handle);
+    rewind(handle);
+    std::vector<char> il(il_size);
+    size_t got = fread(il.data(), 1, il_size, handle);
+    fclose(handle);
+    if (got != il_size) {
+        return NULL;
+    }
+
+    // Create and build; the element type is already baked into the module
+    cl_int err;
+    cl_program program = clCreateProgramWithIL(ctx, il.data(), il_size, &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a program from %s (error %d), using source\n", path.c_str(), err);
+        return NULL;
+    }
+    err = clBuildProgram(program, 0, NULL, "", NULL, NULL);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't build %s, using source\n", path.c_str());
+        print_build_log(program, dev);
+        clReleaseProgram(program);
+        return NULL;
+    }
+    for (const std::string &name : source_kernel_names(filename)) {
+        cl_kernel kernel = clCreateKernel(program, name.c_str(), &err);
+        if (err < 0) {
+            fprintf(stderr, "%s has no kernel %s, using source (rerun build_spirv.sh)\n", path.c_str(), name.c_str());
+            clReleaseProgram(program);
+            return NULL;
+        }
+        clReleaseKernel(kernel);
+    }
+    ocl_startup.il_builds++;
+    return program;
+}
+
+// Build OpenCL program from SPIR-V if available, otherwise from the source file.
+// Returns NULL (after printing the log) on failure.
+// type_name selects the element type of the kernels (-DT=<type>); NULL keeps the default int.
+static inline cl_program build_program(cl_context ctx, cl_device_id dev, const char *filename, const char *type_name) {
+    cl_int err;
+
+    // Offline-compiled module first
+    cl_program program = build_program_il(ctx, dev, filename, type_name);
+    if (program != NULL) {
+        return program;
+    }
+
+    // Open program file
+    FILE *program_handle = fopen(filename, "r");
+    if (program_handle == NULL) {
+        perror("Couldn't find the program file");
+        return NULL;
+    }
+
+    // Get file size
+    fseek(program_handle, 0, SEEK_END);
+    size_t program_size = ftell(program_handle);
+    rewind(program_handle);
+
+    // Read the program source into a buffer
+    char *program_buffer = (char *)malloc(program_size + 1);
+    program_buffer[program_size] = '\0';
+    fread(program_buffer, sizeof(char), program_size, program_handle);
+    fclose(program_handle);
+
+    // Create program from source
+    program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
+    free(program_buffer);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create the program (error %d)\n", err);
+        return NULL;
+    }
+
+    // Build program (compile and link), passing the element type if one was requested
+    char options[64] = "";
+    if (type_name != NULL) {
+        snprintf(options, sizeof(options), "-DT=%s", type_name);
+    }
+    err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
+    if (err < 0) {
+        // If build fails, get and print build log
+        print_build_log(program, dev);
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    ocl_startup.source_builds++;
+    return program;
+}
+
+// Create context, queue and the named kernel built for type_name on a given device.
+// Returns false (with nothing left allocated) on any failure.
+static inline bool ocl_backend_init_device(OclBackend *b, cl_device_id dev, const char *filename,
+                                           const char *kernelname, const char *type_name) {
+    cl_int err;
+    b->device = dev;
+    b->context = NULL;
+    b->queue = NULL;
+    b->program = NULL;
+    b->kernel = NULL;
+
+    // Create OpenCL context and command queue for the selected device
+    auto start = std::chrono::high_resolution_clock::now();
+    b->context = clCreateContext(NULL, 1, &b->device, NULL, NULL, &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a context (error %d)\n", err);
+        return false;
+    }
+    b->queue = clCreateCommandQueueWithProperties(b->context, b->device, 0, &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a command queue (error %d)\n", err);
+        clReleaseContext(b->context);
+        return false;
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    ocl_startup.context_ms += std::chrono::duration<double, std::milli>(stop - start).count();
+
+    // Build program (timed)
+    start = std::chrono::high_resolution_clock::now();
+    b->program = build_program(b->context, b->device, filename, type_name);
+    stop = std::chrono::high_resolution_clock::now();
+    b->build_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    ocl_startup.build_ms += b->build_ms;
+    if (b->program == NULL) {
+        clReleaseCommandQueue(b->queue);
+        clReleaseContext(b->context);
+        return false;
+    }
+
+    // Create kernel from the compiled program
+    b->kernel = clCreateKernel(b->program, kernelname, &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a kernel (error %d)\n", err);
+        clReleaseProgram(b->program);
+        clReleaseCommandQueue(b->queue);
+        clReleaseContext(b->context);
+        return false;
+    }
+    return true;
+}
+
+// Create device, context, queue and the named kernel built for type_name; false on failure
+static inline bool ocl_backend_init(OclBackend *b, const char *filename, const char *kernelname, const char *type_name) {
+    cl_device_id dev = create_device();
+    if (dev == NULL) {
+        return false;
+    }
+    return ocl_backend_init_device(b, dev, filename, kernelname, type_name);
+}
+
+// Add the OpenCL platform and device of a result to its environment record
+static inline void env_capture_opencl(BenchEnv *env, cl_device_id dev) {
+    char buf[256];
+    cl_platform_id platform;
+    clGetDeviceInfo(dev, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+
+    buf[0] = '\0';
+    clGetPlatformInfo(platform, CL_PLATFORM_NAME, sizeof(buf), buf, NULL);
+    env_set(env, "ocl_platform", buf);
+    buf[0] = '\0';
+    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(buf), buf, NULL);
+    env_set(env, "ocl_platform_version", buf);
+    buf[0] = '\0';
+    clGetDeviceInfo(dev, CL_DEVICE_NAME, sizeof(buf), buf, NULL);
+    env_set(env, "ocl_device", buf);
+    buf[0] = '\0';
+    clGetDeviceInfo(dev, CL_DEVICE_VERSION, sizeof(buf), buf, NULL);
+    env_set(env, "ocl_device_version", buf);
+    buf[0] = '\0';
+    clGetDeviceInfo(dev, CL_DRIVER_VERSION, sizeof(buf), buf, NULL);
+    env_set(env, "ocl_driver", buf);
+}
+
+// Release backend objects in reverse order of creation
+static inline void ocl_backend_release(OclBackend *b) {
+    clReleaseKernel(b->kernel);
+    clReleaseCommandQueue(b->queue);
+    clReleaseProgram(b->program);
+    clReleaseContext(b->context);
+}
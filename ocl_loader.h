@@ -0,0 +1,161 @@
+// Lazy loading of the OpenCL runtime.
+//
+// Programs do not link against libOpenCL. The first OpenCL use (ocl_load(), called by
+// create_device() and list_devices()) dlopens the ICD loader and resolves every entry point
+// into ocl_api; afterwards each clXxx call below is redirected to that table. CPU-only runs
+// never load the library or enumerate ICDs, and a host without OpenCL gets an error return
+// instead of a failed program start. OCL_LIBRARY overrides the library path.
+//
+// Every OpenCL function the tools call must be listed in OCL_API_FUNCTIONS and remapped below.
+// Entry points newer than the 2.0 headers are resolved optionally and are NULL when missing.
+#pragma once
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <CL/cl.h>
+
+#define OCL_API_FUNCTIONS(X)               \
+    X(clGetPlatformIDs)                    \
+    X(clGetPlatformInfo)                   \
+    X(clGetDeviceIDs)                      \
+    X(clGetDeviceInfo)                     \
+    X(clCreateSubDevices)                  \
+    X(clReleaseDevice)                     \
+    X(clCreateContext)                     \
+    X(clReleaseContext)                    \
+    X(clCreateCommandQueueWithProperties)  \
+    X(clReleaseCommandQueue)               \
+    X(clCreateBuffer)                      \
+    X(clReleaseMemObject)                  \
+    X(clCreateProgramWithSource)           \
+    X(clBuildProgram)                      \
+    X(clGetProgramBuildInfo)               \
+    X(clReleaseProgram)                    \
+    X(clCreateKernel)                      \
+    X(clSetKernelArg)                      \
+    X(clReleaseKernel)                     \
+    X(clEnqueueNDRangeKernel)              \
+    X(clEnqueueWriteBuffer)                \
+    X(clEnqueueReadBuffer)                 \
+    X(clEnqueueCopyBuffer)                 \
+    X(clEnqueueMigrateMemObjects)          \
+    X(clEnqueueMapBuffer)                  \
+    X(clEnqueueUnmapMemObject)             \
+    X(clWaitForEvents)                     \
+    X(clReleaseEvent)                      \
+    X(clFlush)                             \
+    X(clFinish)
+
+// OpenCL 2.1 additions, not declared when targeting 2.0
+#ifndef CL_DEVICE_IL_VERSION
+#define CL_DEVICE_IL_VERSION 0x105B
+#endif
+typedef cl_program (CL_API_CALL *ocl_create_program_with_il_fn)(cl_context, const void *, size_t, cl_int *);
+
+// Resolved entry points, typed from the declarations in CL/cl.h
+struct OclApi {
+#define OCL_API_MEMBER(name) decltype(&::name) name;
+    OCL_API_FUNCTIONS(OCL_API_MEMBER)
+#undef OCL_API_MEMBER
+    ocl_create_program_with_il_fn clCreateProgramWithIL; // Optional (2.1+)
+};
+
+// Time spent in each OpenCL startup phase (ms), for reporting
+struct OclStartup {
+    bool loaded;         // Library loaded and resolved
+    double load_ms;      // dlopen + dlsym
+    double discover_ms;  // Platform/device enumeration (ICD discovery happens here)
+    double context_ms;   // Context and queue creation
+    double build_ms;     // Program build(s)
+    int il_builds;       // Programs built from offline-compiled SPIR-V
+    int source_builds;   // Programs compiled from OpenCL C source
+};
+
+static OclApi ocl_api;
+static OclStartup ocl_startup;
+static int ocl_load_state = 0; // 0 not tried, 1 loaded, -1 failed
+
+// Load the OpenCL runtime on first call; returns false (once reported) if it is unavailable
+static inline bool ocl_load() {
+    if (ocl_load_state != 0) {
+        return ocl_load_state > 0;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const char *path = getenv("OCL_LIBRARY");
+    void *lib = dlopen(path != NULL ? path : "libOpenCL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL && path == NULL) {
+        lib = dlopen("libOpenCL.so", RTLD_NOW | RTLD_LOCAL);
+    }
+    if (lib == NULL) {
+        fprintf(stderr, "OpenCL unavailable: %s\n", dlerror());
+        ocl_load_state = -1;
+        return false;
+    }
+
+    // Resolve every entry point; a missing one means an unusable runtime
+#define OCL_API_RESOLVE(name)                                             \
+    ocl_api.name = (decltype(ocl_api.name))dlsym(lib, #name);              \
+    if (ocl_api.name == NULL) {                                           \
+        fprintf(stderr, "OpenCL unavailable: %s missing\n", #name);       \
+        dlclose(lib);                                                     \
+        ocl_load_state = -1;                                              \
+        return false;                                                     \
+    }
+    OCL_API_FUNCTIONS(OCL_API_RESOLVE)
+#undef OCL_API_RESOLVE
+    ocl_api.clCreateProgramWithIL = (ocl_create_program_with_il_fn)dlsym(lib, "clCreateProgramWithIL");
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    ocl_startup.loaded = true;
+    ocl_startup.load_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    ocl_load_state = 1;
+    return true;
+}
+
+// Print the startup phases measured so far
+static inline void ocl_print_startup(FILE *out) {
+    if (!ocl_startup.loaded) {
+        fprintf(out, "[startup] OpenCL not loaded\n");
+        return;
+    }
+    fprintf(out, "[startup] OpenCL load %.3f ms, discovery %.3f ms, context+queue %.3f ms, build %.3f ms"
+            " (%d from SPIR-V, %d from source)\n",
+            ocl_startup.load_ms, ocl_startup.discover_ms, ocl_startup.context_ms, ocl_startup.build_ms,
+            ocl_startup.il_builds, ocl_startup.source_builds);
+}
+
+// From here on, OpenCL calls go through the loaded table
+#define clGetPlatformIDs ocl_api.clGetPlatformIDs
+#define clGetPlatformInfo ocl_api.clGetPlatformInfo
+#define clGetDeviceIDs ocl_api.clGetDeviceIDs
+#define clGetDeviceInfo ocl_api.clGetDeviceInfo
+#define clCreateSubDevices ocl_api.clCreateSubDevices
+#define clReleaseDevice ocl_api.clReleaseDevice
+#define clCreateContext ocl_api.clCreateContext
+#define clReleaseContext ocl_api.clReleaseContext
+#define clCreateCommandQueueWithProperties ocl_api.clCreateCommandQueueWithProperties
+#define clReleaseCommandQueue ocl_api.clReleaseCommandQueue
+#define clCreateBuffer ocl_api.clCreateBuffer
+#define clReleaseMemObject ocl_api.clReleaseMemObject
+#define clCreateProgramWithSource ocl_api.clCreateProgramWithSource
+#define clBuildProgram ocl_api.clBuildProgram
+#define clGetProgramBuildInfo ocl_api.clGetProgramBuildInfo
+#define clReleaseProgram ocl_api.clReleaseProgram
+#define clCreateKernel ocl_api.clCreateKernel
+#define clSetKernelArg ocl_api.clSetKernelArg
+#define clReleaseKernel ocl_api.clReleaseKernel
+#define clEnqueueNDRangeKernel ocl_api.clEnqueueNDRangeKernel
+#define clEnqueueWriteBuffer ocl_api.clEnqueueWriteBuffer
+#define clEnqueueReadBuffer ocl_api.clEnqueueReadBuffer
+#define clEnqueueCopyBuffer ocl_api.clEnqueueCopyBuffer
+#define clEnqueueMigrateMemObjects ocl_api.clEnqueueMigrateMemObjects
+#define clEnqueueMapBuffer ocl_api.clEnqueueMapBuffer
+#define clEnqueueUnmapMemObject ocl_api.clEnqueueUnmapMemObject
+#define clWaitForEvents ocl_api.clWaitForEvents
+#define clReleaseEvent ocl_api.clReleaseEvent
+#define clFlush ocl_api.clFlush
+#define clFinish ocl_api.clFinish
+#define clCreateProgramWithIL ocl_api.clCreateProgramWithIL
@@ -0,0 +1,151 @@
+// Host/device residency tracking for vectors shared by OpenCL kernels and host code.
+//
+// A DeviceVector pairs a host array with a lazily created device buffer and records, for each
+// side, the element range where the other side holds newer data. Data only moves when a user
+// needs it on a side where it is stale, and only the stale range moves:
+//
+//   dv_device_read()   kernel will read it: upload the range the host changed since last time
+//   dv_device_write()  kernel will overwrite all of it: no upload, host copy becomes stale
+//   dv_host_read()     host will read it: download the range kernels changed since last time
+//   dv_host_write()    host is about to change [lo, hi): device copy becomes stale there
+//
+// A vector used as input by several consecutive kernels is therefore uploaded once. Uploads
+// are non-blocking and read the host array until they complete, so call dv_host_write()
+// before writing: it waits for an upload still in flight.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ocl_common.h"
+
+// Host array plus device buffer and the stale ranges of each copy
+struct DeviceVector {
+    int *host;
+    long size;
+    cl_context context;
+    cl_mem buf;                  // NULL until first device use
+    cl_event upload;             // Last non-blocking upload, NULL once it is known to be done
+    long dev_stale_lo, dev_stale_hi;   // Device copy is older than host in [lo, hi)
+    long host_stale_lo, host_stale_hi; // Host copy is older than device in [lo, hi)
+    long bytes_h2d, bytes_d2h;         // Bytes actually transferred
+};
+
+// Grow [*lo, *hi) to also cover [lo, hi) (empty ranges have lo == hi)
+static inline void dv_range_union(long *lo, long *hi, long add_lo, long add_hi) {
+    if (add_lo >= add_hi) {
+        return;
+    }
+    if (*lo >= *hi) {
+        *lo = add_lo;
+        *hi = add_hi;
+        return;
+    }
+    *lo = add_lo < *lo ? add_lo : *lo;
+    *hi = add_hi > *hi ? add_hi : *hi;
+}
+
+// Wrap a host array whose contents are valid; nothing is allocated on the device yet
+static inline void dv_create(DeviceVector *dv, cl_context context, int *host, long size) {
+    dv->host = host;
+    dv->size = size;
+    dv->context = context;
+    dv->buf = NULL;
+    dv->upload = NULL;
+    dv->dev_stale_lo = 0;
+    dv->dev_stale_hi = size; // Device holds nothing yet
+    dv->host_stale_lo = dv->host_stale_hi = 0;
+    dv->bytes_h2d = dv->bytes_d2h = 0;
+}
+
+// Create the device buffer on first use
+static inline void dv_ensure_buffer(DeviceVector *dv) {
+    if (dv->buf == NULL) {
+        cl_int err;
+        dv->buf = clCreateBuffer(dv->context, CL_MEM_READ_WRITE, dv->size * sizeof(int), NULL, &err);
+        if (err < 0) {
+            perror("Couldn't create a buffer");
+            exit(1);
+        }
+    }
+}
+
+// Buffer with current contents for a kernel to read; uploads only the host-modified range
+static inline cl_mem dv_device_read(DeviceVector *dv, cl_command_queue queue) {
+    dv_ensure_buffer(dv);
+    if (dv->dev_stale_lo < dv->dev_stale_hi) {
+        size_t bytes = (dv->dev_stale_hi - dv->dev_stale_lo) * sizeof(int);
+        if (dv->upload != NULL) {
+            clReleaseEvent(dv->upload);
+        }
+        clEnqueueWriteBuffer(queue, dv->buf, CL_FALSE, dv->dev_stale_lo * sizeof(int), bytes,
+                             dv->host + dv->dev_stale_lo, 0, NULL, &dv->upload);
+        dv->bytes_h2d += bytes;
+        dv->dev_stale_lo = dv->dev_stale_hi = 0;
+    }
+    return dv->buf;
+}
+
+// Buffer a kernel will completely overwrite; no upload, and the host copy becomes stale
+static inline cl_mem dv_device_write(DeviceVector *dv) {
+    dv_ensure_buffer(dv);
+    dv->dev_stale_lo = dv->dev_stale_hi = 0;
+    dv->host_stale_lo = 0;
+    dv->host_stale_hi = dv->size;
+    return dv->buf;
+}
+
+// Host pointer with current contents; downloads only the device-modified range
+static inline int *dv_host_read(DeviceVector *dv, cl_command_queue queue) {
+    if (dv->host_stale_lo < dv->host_stale_hi) {
+        size_t bytes = (dv->host_stale_hi - dv->host_stale_lo) * sizeof(int);
+        clEnqueueReadBuffer(queue, dv->buf, CL_TRUE, dv->host_stale_lo * sizeof(int), bytes,
+                            dv->host + dv->host_stale_lo, 0, NULL, NULL);
+        dv->bytes_d2h += bytes;
+        dv->host_stale_lo = dv->host_stale_hi = 0;
+    }
+    return dv->host;
+}
+
+// Prepare the host to write [lo, hi); call it before writing. Waits for an upload that may
+// still be reading the host array, and fetches stale host data unless the write covers all
+// of it (fetching after the write would overwrite the new values), so each side keeps a
+// single stale range.
+static inline void dv_host_write(DeviceVector *dv, cl_command_queue queue, long lo, long hi) {
+    if (dv->upload != NULL) {
+        clWaitForEvents(1, &dv->upload);
+        clReleaseEvent(dv->upload);
+        dv->upload = NULL;
+    }
+    if (dv->host_stale_lo < dv->host_stale_hi && !(lo <= dv->host_stale_lo && dv->host_stale_hi <= hi)) {
+        dv_host_read(dv, queue);
+    }
+    dv->host_stale_lo = dv->host_stale_hi = 0;
+    dv_range_union(&dv->dev_stale_lo, &dv->dev_stale_hi, lo, hi);
+}
+
+// Release the device buffer (the host array belongs to the caller)
+static inline void dv_release(DeviceVector *dv) {
+    if (dv->upload != NULL) {
+        clWaitForEvents(1, &dv->upload);
+        clReleaseEvent(dv->upload);
+        dv->upload = NULL;
+    }
+    if (dv->buf != NULL) {
+        clReleaseMemObject(dv->buf);
+        dv->buf = NULL;
+    }
+}
+
+// out = a + b on the device, moving only the data the kernel needs
+static inline void dv_vector_add(cl_command_queue queue, cl_kernel kernel, DeviceVector *a, DeviceVector *b, DeviceVector *out) {
+    int size = (int)out->size;
+    cl_mem bufA = dv_device_read(a, queue);
+    cl_mem bufB = dv_device_read(b, queue);
+    cl_mem bufOut = dv_device_write(out);
+    size_t global[1] = {(size_t)size};
+    clSetKernelArg(kernel, 0, sizeof(int), &size);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufA);
+    clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufB);
+    clSetKernelArg(kernel, 3, sizeof(cl_mem), &bufOut);
+    clEnqueueNDRangeKernel(queue, kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+}
@@ -0,0 +1,190 @@
+// Host/device transfer modes for OpenCL vectors.
+//
+//   pageable  clEnqueueWriteBuffer / ReadBuffer straight from malloc'd memory; the driver has to
+//             bounce the data through pinned memory of its own
+//   mlock     the same, with the host range locked (mlock) for the duration of the transfer so
+//             its pages stay resident and cannot move
+//   pinned    through staging buffers the runtime allocates in pinned, DMA-able host memory
+//             (CL_MEM_ALLOC_HOST_PTR): host data is copied into a mapped staging buffer, which
+//             clEnqueueCopyBuffer then moves to the device buffer
+//   migrate   pageable writes, then clEnqueueMigrateMemObjects to make the inputs resident on
+//             the device before the kernel runs, and the output resident with undefined
+//             content so nothing is copied for it
+//
+// Uploads are enqueued without blocking and completed together by xfer_finish(), so the
+// writes of all inputs overlap instead of waiting for each other.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <utility>
+#include <vector>
+#include "ocl_common.h"
+
+enum TransferMode { XFER_PAGEABLE, XFER_MLOCK, XFER_PINNED, XFER_MIGRATE };
+static const char *TRANSFER_MODE_NAMES[] = {"pageable", "mlock", "pinned", "migrate"};
+
+// Mode with the given name, or -1
+static inline int transfer_mode_parse(const char *name) {
+    for (int m = 0; m < 4; m++) {
+        if (strcmp(name, TRANSFER_MODE_NAMES[m]) == 0) {
+            return m;
+        }
+    }
+    return -1;
+}
+
+// Transfer state for one queue; staging buffers are kept and reused across batches
+struct OclTransfer {
+    TransferMode mode;
+    cl_context context;
+    cl_command_queue queue;
+    std::vector<cl_mem> staging;                   // Pinned staging buffers
+    std::vector<size_t> staging_bytes;
+    int staging_used;                              // Staging buffers taken by the current batch
+    std::vector<std::pair<void *, size_t>> locked; // Ranges mlocked by the current batch
+    std::vector<cl_mem> inputs, outputs;           // Buffers to migrate at xfer_finish()
+};
+
+static inline void xfer_init(OclTransfer *t, cl_context context, cl_command_queue queue, TransferMode mode) {
+    t->mode = mode;
+    t->context = context;
+    t->queue = queue;
+    t->staging.clear();
+    t->staging_bytes.clear();
+    t->staging_used = 0;
+    t->locked.clear();
+    t->inputs.clear();
+    t->outputs.clear();
+}
+
+// Next free staging buffer of at least bytes, created on first need; NULL on failure
+static inline cl_mem xfer_staging(OclTransfer *t, size_t bytes) {
+    int i = t->staging_used++;
+    if (i < (int)t->staging.size() && t->staging_bytes[i] >= bytes) {
+        return t->staging[i];
+    }
+    cl_int err;
+    cl_mem buf = clCreateBuffer(t->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a pinned staging buffer (error %d)\n", err);
+        t->staging_used--;
+        return NULL;
+    }
+    if (i < (int)t->staging.size()) {
+        clReleaseMemObject(t->staging[i]);
+        t->staging[i] = buf;
+        t->staging_bytes[i] = bytes;
+    } else {
+        t->staging.push_back(buf);
+        t->staging_bytes.push_back(bytes);
+    }
+    return buf;
+}
+
+// Lock a host range until the end of the batch (warns once and carries on if not permitted)
+static inline void xfer_lock(OclTransfer *t, const void *p, size_t bytes) {
+    static bool warned = false;
+    if (mlock(p, bytes) != 0) {
+        if (!warned) {
+            perror("Couldn't lock host memory (see ulimit -l), transferring unlocked");
+            warned = true;
+        }
+        return;
+    }
+    t->locked.push_back(std::make_pair((void *)p, bytes));
+}
+
+// Enqueue a host-to-device copy of bytes from src into dst; src must stay valid until
+// xfer_finish(). Returns false if the transfer could not be set up.
+static inline bool xfer_upload(OclTransfer *t, cl_mem dst, const void *src, size_t bytes) {
+    if (t->mode == XFER_PINNED) {
+        cl_mem stage = xfer_staging(t, bytes);
+        if (stage == NULL) {
+            return false;
+        }
+        cl_int err;
+        void *p = clEnqueueMapBuffer(t->queue, stage, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, bytes, 0, NULL, NULL, &err);
+        if (err < 0) {
+            fprintf(stderr, "Couldn't map a staging buffer (error %d)\n", err);
+            return false;
+        }
+        memcpy(p, src, bytes);
+        clEnqueueUnmapMemObject(t->queue, stage, p, 0, NULL, NULL);
+        clEnqueueCopyBuffer(t->queue, stage, dst, 0, 0, bytes, 0, NULL, NULL);
+        return true;
+    }
+    if (t->mode == XFER_MLOCK) {
+        xfer_lock(t, src, bytes);
+    }
+    if (t->mode == XFER_MIGRATE) {
+        t->inputs.push_back(dst);
+    }
+    clEnqueueWriteBuffer(t->queue, dst, CL_FALSE, 0, bytes, src, 0, NULL, NULL);
+    return true;
+}
+
+// Declare a buffer the next kernel overwrites completely (migrated without its content)
+static inline void xfer_output(OclTransfer *t, cl_mem buf) {
+    if (t->mode == XFER_MIGRATE) {
+        t->outputs.push_back(buf);
+    }
+}
+
+// Issue the migrations of the batch, wait for all transfers and release the locks
+static inline void xfer_finish(OclTransfer *t) {
+    if (!t->inputs.empty()) {
+        clEnqueueMigrateMemObjects(t->queue, t->inputs.size(), t->inputs.data(), 0, 0, NULL, NULL);
+    }
+    if (!t->outputs.empty()) {
+        clEnqueueMigrateMemObjects(t->queue, t->outputs.size(), t->outputs.data(),
+                                   CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED, 0, NULL, NULL);
+    }
+    clFinish(t->queue);
+    for (auto &range : t->locked) {
+        munlock(range.first, range.second);
+    }
+    t->locked.clear();
+    t->inputs.clear();
+    t->outputs.clear();
+    t->staging_used = 0;
+}
+
+// Copy bytes from src on the device into dst on the host (blocking). Returns false if the
+// transfer could not be set up.
+static inline bool xfer_download(OclTransfer *t, cl_mem src, void *dst, size_t bytes) {
+    if (t->mode == XFER_PINNED) {
+        cl_mem stage = xfer_staging(t, bytes);
+        if (stage == NULL) {
+            return false;
+        }
+        clEnqueueCopyBuffer(t->queue, src, stage, 0, 0, bytes, 0, NULL, NULL);
+        cl_int err;
+        void *p = clEnqueueMapBuffer(t->queue, stage, CL_TRUE, CL_MAP_READ, 0, bytes, 0, NULL, NULL, &err);
+        if (err < 0) {
+            fprintf(stderr, "Couldn't map a staging buffer (error %d)\n", err);
+            return false;
+        }
+        memcpy(dst, p, bytes);
+        clEnqueueUnmapMemObject(t->queue, stage, p, 0, NULL, NULL);
+        xfer_finish(t);
+        return true;
+    }
+    if (t->mode == XFER_MLOCK) {
+        xfer_lock(t, dst, bytes);
+    }
+    clEnqueueReadBuffer(t->queue, src, CL_TRUE, 0, bytes, dst, 0, NULL, NULL);
+    xfer_finish(t);
+    return true;
+}
+
+// Release the staging buffers
+static inline void xfer_release(OclTransfer *t) {
+    for (cl_mem buf : t->staging) {
+        clReleaseMemObject(buf);
+    }
+    t->staging.clear();
+    t->staging_bytes.clear();
+}
@@ -0,0 +1,90 @@
+// Low-jitter setup for latency-critical adds: no page faults and no preemption while an add runs.
+//
+// Jitter sources and what removes them:
+//   page faults         rt_lock_memory() locks current and future pages (mlockall) and
+//                       rt_prefault() touches every page of a buffer before the first add
+//   scheduler noise     rt_pin_team() pins each OpenMP thread to one CPU of a set, by default
+//                       rt_isolated_cpus(): CPUs the kernel keeps other tasks off (isolcpus=)
+//                       and/or runs tickless (nohz_full=)
+//   preemption          rt_pin_team() can also move the threads to SCHED_FIFO, above every
+//                       normal task. A spinning FIFO thread can starve its CPU; keep it to
+//                       isolated CPUs (the kernel's RT throttling still reserves 5% by default).
+// mlockall needs RLIMIT_MEMLOCK headroom or CAP_IPC_LOCK, SCHED_FIFO needs CAP_SYS_NICE or
+// an rtprio limit; failures are reported and the rest of the setup still applies.
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <omp.h> // For OpenMP multi-threading
+#include "antagonist.h" // antagonist_cpu_list
+#include "cgroup_limits.h" // cgroup_read_line
+
+// CPUs listed in isolcpus= or nohz_full= (empty if the kernel isolates none)
+static inline std::vector<int> rt_isolated_cpus() {
+    std::vector<int> cpus;
+    for (const char *file : {"/sys/devices/system/cpu/isolated", "/sys/devices/system/cpu/nohz_full"}) {
+        std::string list = cgroup_read_line(file);
+        for (int c : antagonist_cpu_list(list.c_str())) {
+            bool seen = false;
+            for (int other : cpus) {
+                seen = seen || other == c;
+            }
+            if (!seen) {
+                cpus.push_back(c);
+            }
+        }
+    }
+    return cpus;
+}
+
+// Lock all current and future pages in memory; false (with a message) if not permitted
+static inline bool rt_lock_memory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        perror("WARNING: mlockall failed (raise RLIMIT_MEMLOCK or grant CAP_IPC_LOCK)");
+        return false;
+    }
+    return true;
+}
+
+// Touch every page of [p, p + bytes) so the first real access does not fault
+static inline void rt_prefault(void *p, size_t bytes) {
+    long page = sysconf(_SC_PAGESIZE);
+    volatile char *c = (volatile char *)p;
+    for (size_t off = 0; off < bytes; off += page) {
+        c[off] = c[off];
+    }
+}
+
+// Start a team of threads OpenMP threads, thread t pinned to cpus[t % size] and, if
+// fifo_priority > 0, running SCHED_FIFO at that priority; the team is reused by later parallel
+// regions of the same size. Returns the number of threads that could not get SCHED_FIFO.
+static inline int rt_pin_team(const std::vector<int> &cpus, int threads, int fifo_priority) {
+    int fifo_failed = 0;
+    #pragma omp parallel num_threads(threads) reduction(+ : fifo_failed)
+    {
+        int t = omp_get_thread_num();
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[t % cpus.size()], &one);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(one), &one) != 0) {
+            fprintf(stderr, "WARNING: thread %d could not be pinned to CPU %d\n", t, cpus[t % cpus.size()]);
+        }
+        if (fifo_priority > 0) {
+            struct sched_param param;
+            param.sched_priority = fifo_priority;
+            fifo_failed += pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0;
+        }
+    }
+    if (fifo_failed > 0) {
+        fprintf(stderr, "WARNING: %d thread(s) could not switch to SCHED_FIFO (needs CAP_SYS_NICE or an rtprio limit)\n",
+                fifo_failed);
+    }
+    return fifo_failed;
+}
@@ -0,0 +1,126 @@
+// A/B comparison of two vector_add configurations or builds.
+//
+// Build: g++ -O2 vector_add_ab.cpp -o vector_add_ab
+// Usage: ./vector_add_ab "<command A>" "<command B>" [runs]
+//   e.g. ./vector_add_ab "OMP_NUM_THREADS=2 ./vector_add_openmp 10000000"
+//                        "OMP_NUM_THREADS=4 ./vector_add_openmp 10000000" 30
+//
+// Each command is run through the shell and must print an "... Execution Time: <ms> ms"
+// line, as vector_add_openmp and vector_add_opencl do. Runs of A and B are interleaved
+// in pairs (random order within each pair) so slow drift of the machine affects both sides.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bench_env.h"
+#include "bench_stats.h"
+
+#define WARMUP_RUNS 1      // Runs per command discarded before measuring
+#define BOOTSTRAP_RESAMPLES 10000
+#define CONFIDENCE 0.95
+
+int RUNS = 20; // Default number of measured runs per command
+
+// Function declarations
+double run_command(const char *cmd);
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s \"<command A>\" \"<command B>\" [runs]\n", argv[0]);
+        return 1;
+    }
+    const char *cmd_a = argv[1];
+    const char *cmd_b = argv[2];
+
+    // Allow number of runs to be set via command-line argument
+    if (argc > 3) {
+        RUNS = atoi(argv[3]);
+    }
+    if (RUNS < 3) {
+        printf("Need at least 3 runs per command\n");
+        return 1;
+    }
+
+    printf("A: %s\n", cmd_a);
+    printf("B: %s\n", cmd_b);
+
+    // Both sides run on this machine; record its settings once
+    BenchEnv env;
+    env_capture(&env);
+    env_print(&env, stdout);
+    env_warn(&env);
+
+    // Warm up caches, page cache and frequency governors
+    for (int i = 0; i < WARMUP_RUNS; i++) {
+        run_command(cmd_a);
+        run_command(cmd_b);
+    }
+
+    // Interleave measured runs, randomizing which command goes first in each pair
+    std::vector<double> times_a, times_b;
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (int i = 0; i < RUNS; i++) {
+        double ta, tb;
+        if (stats_rand(&state) & 1) {
+            ta = run_command(cmd_a);
+            tb = run_command(cmd_b);
+        } else {
+            tb = run_command(cmd_b);
+            ta = run_command(cmd_a);
+        }
+        times_a.push_back(ta);
+        times_b.push_back(tb);
+        printf("run %3d: A %10.3f ms   B %10.3f ms\n", i + 1, ta, tb);
+    }
+
+    // Summarize each side
+    double med_a = median(times_a);
+    double med_b = median(times_b);
+    printf("----------------------------\n");
+    printf("A: median %.3f ms  MAD %.3f ms  min %.3f ms\n", med_a, mad(times_a), percentile(times_a, 0));
+    printf("B: median %.3f ms  MAD %.3f ms  min %.3f ms\n", med_b, mad(times_b), percentile(times_b, 0));
+
+    // Bootstrap confidence interval on the median difference (B - A)
+    double lo, hi;
+    bootstrap_median_diff_ci(times_a, times_b, BOOTSTRAP_RESAMPLES, CONFIDENCE, &lo, &hi);
+    double diff = med_b - med_a;
+    printf("median(B) - median(A): %+.3f ms  (%.0f%% CI [%+.3f, %+.3f] ms, %+.2f%%)\n",
+           diff, CONFIDENCE * 100, lo, hi, 100.0 * diff / med_a);
+
+    // Significant only if the whole interval lies on one side of zero
+    if (hi < 0) {
+        printf("Result: B is significantly FASTER (speedup %.3fx)\n", med_a / med_b);
+    } else if (lo > 0) {
+        printf("Result: B is significantly SLOWER (slowdown %.3fx)\n", med_b / med_a);
+    } else {
+        printf("Result: no significant difference at %.0f%% confidence\n", CONFIDENCE * 100);
+    }
+
+    return 0;
+}
+
+// Run a command through the shell and return the last reported execution time in ms
+double run_command(const char *cmd) {
+    FILE *pipe = popen(cmd, "r");
+    if (pipe == NULL) {
+        perror("Couldn't run command");
+        exit(1);
+    }
+
+    // Scan all output; the timing line is the last "Execution Time:" line printed
+    char line[4096];
+    double ms = -1.0;
+    while (fgets(line, sizeof(line), pipe) != NULL) {
+        char *p = strstr(line, "Execution Time:");
+        if (p != NULL) {
+            ms = atof(p + strlen("Execution Time:"));
+        }
+    }
+
+    int status = pclose(pipe);
+    if (status != 0 || ms < 0) {
+        printf("Command failed or printed no execution time: %s\n", cmd);
+        exit(1);
+    }
+    return ms;
+}
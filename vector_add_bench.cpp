@@ -0,0 +1,1791 @@
+// Benchmark suite for the vector add backends.
+//
+// Build: g++ -O3 -fopenmp vector_add_bench.cpp -o vector_add_bench -ldl -lnuma
+// Usage: ./vector_add_bench suite [--baseline=<file>] [--update] [--tolerance=0.05]
+//                                 [--backends=openmp,opencl] [--ci=0.02] [--budget=2]
+//                                 [--min-reps=5] [--max-reps=1000]
+//        ./vector_add_bench micro [--backends=openmp,opencl] [--reps=2000]
+//        ./vector_add_bench platforms [--types=int,float] [--modes=copy,hostptr]
+//        ./vector_add_bench adaptive [--size=67108864] [--iters=50] [--opencl]
+//        ./vector_add_bench tune [--tuning=<file>] [--budget=0.2] [--verbose]
+//        ./vector_add_bench numa [--policy=firsttouch|interleave|bind] [--migrate]
+//                                [--size=67108864] [--iters=20]
+//        ./vector_add_bench residency [--size=16777216] [--ops=8]
+//        ./vector_add_bench transfer [--size=16777216] [--modes=pageable,mlock,pinned,migrate]
+//        ./vector_add_bench oversub [--size=16777216] [--ocl-share=0.5]
+//        ./vector_add_bench concurrent [--jobs=4] [--size=4194304] [--small=65536] [--iters=20]
+//                                      [--opencl] [--bw-cap]
+//        ./vector_add_bench neighbors [--size=16777216] [--threads=0] [--kinds=bandwidth,cache]
+//                                     [--counts=1,2,4] [--ant-cpus=<list>|--ant-node=<n>] [--ant-mb=64]
+//                                     [--opencl]
+//        ./vector_add_bench scaling [--size=10000000] [--jobs=1,2,4,8] [--tpj=<list>] [--iters=5]
+//                                   [--opencl]
+//        ./vector_add_bench jitter [--size=65536] [--iters=20000] [--threads=0] [--cpus=<list>]
+//                                  [--fifo=<priority>]
+//
+// suite runs a fixed matrix (backends x sizes x types x thread counts). Without a baseline
+// file (default vector_add_baseline.<hostname>.txt) or with --update it records one;
+// otherwise it compares against it and exits 1 if any configuration regressed or is missing
+// from the run (e.g. OpenCL setup failed) although its backend was selected.
+// Each configuration repeats until the 95% CI of its median (after discarding outliers)
+// is within --ci of the median, or --budget seconds are spent.
+//
+// micro measures fixed dispatch costs in microseconds: empty OpenMP region and OpenCL
+// kernel, tiny adds of 1-1024 elements, enqueue and event wait, buffer create/release.
+//
+// platforms runs the same kernels, sizes and transfer modes on every installed OpenCL
+// platform/device and prints build time, transfer bandwidth and kernel bandwidth side by side.
+//
+// adaptive runs repeated long adds through the engine, which keeps re-timing variants on
+// chunks and switches to the fastest; run it next to other load to watch it react.
+//
+// tune searches the CPU kernel family (cpu_kernels.h) per size class and records the winners
+// (default vector_add_tune.<hostname>.txt), which vector_add_openmp then uses.
+//
+// numa allocates the vectors with a placement policy, fills them from the main thread (as
+// data arriving from a file or another process would be), and with --migrate moves each
+// thread's chunk to its node, reporting migration cost against the per-iteration gain.
+//
+// residency runs a chain of dependent OpenCL adds (t = v1 + t, with one small host edit of
+// v1 midway) twice: copying every input in and the output out for each op, as
+// vector_add_opencl does, and through DeviceVector (ocl_residency.h), which only moves stale data.
+//
+// transfer measures host-to-device (both inputs), device-to-host and upload + kernel + download
+// for each transfer mode of ocl_transfer.h (pageable, mlock'd, pinned staging, migration).
+//
+// oversub co-executes one add on an OpenCL CPU device (--ocl-share of the elements) and an
+// OpenMP team (the rest), once with both runtimes using every core and once with the cores
+// split by cpu_budget.h. Each case runs in a child process, because runtime thread limits only
+// take effect before OpenCL is loaded.
+//
+// concurrent starts --jobs caller threads that issue adds at the same time (caller 0 issues
+// --small ones, the others --size ones), through a per-call OpenMP team each, through the
+// shared worker pool (vector_add_pool.h) and, with --opencl, through per-call OpenCL queues.
+// It prints aggregate bandwidth and per-call latency, separately for the small caller. With
+// --bw-cap the pool first measures where each NUMA node's bandwidth saturates and caps its
+// busy workers there.
+//
+// neighbors measures the OpenMP add (--threads team, 0 = all) and, with --opencl, the OpenCL
+// kernel while background antagonist threads (antagonist.h) take memory bandwidth or thrash
+// the last-level cache, for each kind and count, and prints throughput and slowdown against
+// the quiet machine. Pin the antagonists with --ant-cpus or to a node's CPUs and memory with
+// --ant-node to compare placements; leave them unpinned to see the scheduler's choice.
+//
+// scaling runs M = --jobs concurrent jobs, each --iters adds of --size elements, and compares
+// running them one after another with every thread (serial) against running them at once:
+// each with its own OpenMP team of T threads for every T in --tpj (default 1, 2, 4, ... up to
+// all), through the shared pool, and with --opencl through per-job OpenCL queues. It prints
+// aggregate bandwidth, the makespan against serial and per-add latency.
+//
+// jitter times --iters back-to-back adds of --size elements on fresh vectors twice: as an
+// ordinary process, then in low-jitter mode (realtime.h): memory locked and prefaulted, the
+// OpenMP team pinned one thread per CPU to the isolated CPUs (isolcpus/nohz_full; --cpus to
+// choose, the allowed CPUs if none are isolated) and with --fifo on SCHED_FIFO. Both runs use a
+// team of --threads (default one per CPU of the set); --fifo needs at most one thread per CPU.
+// It prints the latency distribution, page faults and involuntary context switches of both runs.
+//
+// OpenCL is loaded only by commands that use it; its startup cost is printed at the end. Without
+// a usable OpenCL runtime the OpenCL rows are skipped and the CPU results are still produced.
+// Default OpenMP team sizes follow the container's CPU quota and cpuset (cgroup_limits.h)
+// unless OMP_NUM_THREADS is set.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <omp.h> // For OpenMP multi-threading
+#include "bench_stats.h"
+#include "ocl_common.h"
+#include "cpu_kernels.h"
+#include "numa_policy.h"
+#include "ocl_residency.h"
+#include "ocl_transfer.h"
+#include "cpu_budget.h"
+#include "antagonist.h"
+#include "realtime.h"
+#include "vector_add_pool.h"
+#include "vector_add_engine.h"
+
+#define WARMUP_REPS 2      // Untimed repetitions before each measurement
+#define NOISE_SIGMAS 3.0   // Regression must exceed this many combined noise sigmas
+#define MAD_TO_SIGMA 1.4826 // Scales a MAD to a normal standard deviation
+
+// Fixed suite matrix
+const int SUITE_SIZES[] = {1 << 16, 1 << 20, 1 << 24};
+const char *SUITE_TYPES[] = {"int", "float", "double"};
+
+// Element counts for the tiny-add microbenchmarks
+const int MICRO_SIZES[] = {1, 4, 16, 64, 256, 1024};
+#define MICRO_WARMUP 20 // Untimed repetitions before each microbenchmark
+
+// Element counts for the platform comparison
+const int PLATFORM_SIZES[] = {1 << 20, 1 << 24};
+
+// One measured configuration of the matrix
+struct Result {
+    std::string backend;
+    std::string type;
+    int size;
+    int threads;       // OpenMP team size (0 for OpenCL)
+    double median_ms;
+    double mad_ms;
+    int reps;          // Repetitions needed to reach the CI target
+};
+
+// Settings of the machine the results are measured on
+BenchEnv ENV;
+
+// Command-line options
+int argc_g;
+char **argv_g;
+AdaptiveConfig ADAPTIVE = {5, 1000, 0.02, 2.0}; // Repetition stopping rule for suite measurements
+
+// Function declarations
+const char *opt(const char *name, const char *def);
+bool has_flag(const char *name);
+std::vector<int> int_list(const char *list);
+int cmd_suite();
+int cmd_micro();
+void micro_openmp(int reps);
+void micro_opencl(int reps);
+void print_micro(const char *name, std::vector<double> us);
+int cmd_platforms();
+int cmd_adaptive();
+int cmd_tune();
+int cmd_numa();
+int cmd_residency();
+int cmd_transfer();
+int cmd_oversub();
+int cmd_concurrent();
+int cmd_neighbors();
+int cmd_scaling();
+int cmd_jitter();
+template <typename T> void platform_rows(const OclDeviceRef &ref, const char *type, const char *modes);
+void run_suite(std::vector<Result> &results);
+template <typename T> void suite_openmp(const char *type, std::vector<Result> &results);
+template <typename T> void suite_opencl(const char *type, std::vector<Result> &results);
+void write_baseline(const char *path, const std::vector<Result> &results);
+bool read_baseline(const char *path, std::vector<Result> &results, BenchEnv *env);
+int compare_results(const std::vector<Result> &base, const std::vector<Result> &cur, double tolerance, const char *backends);
+template <typename T> void init_t(T *&A, int size);
+template <typename T> void check_t(const T *v1, const T *v2, const T *v_out, int size, const char *what);
+template <typename F> void measure(F run_once, Result *r);
+template <typename F> double time_median_ms(F run_once);
+template <typename F> double run_jobs(int jobs, int iters, bool serial, std::vector<std::vector<double>> &lat, F add);
+
+int main(int argc, char **argv) {
+    argc_g = argc;
+    argv_g = argv;
+    if (argc < 2) {
+        printf("Usage: %s suite|micro|platforms|adaptive|tune|numa|residency|transfer|oversub|concurrent|neighbors|scaling|jitter [options]\n", argv[0]);
+        return 1;
+    }
+
+    // Every command records machine settings with its results and sizes its default OpenMP
+    // team to the container's CPU limit
+    env_capture(&ENV);
+    CgroupLimits cgroup;
+    cgroup_detect(&cgroup);
+    cgroup_apply_omp(&cgroup);
+
+    // Dispatch on the command name
+    int rc;
+    if (strcmp(argv[1], "suite") == 0) {
+        rc = cmd_suite();
+    } else if (strcmp(argv[1], "micro") == 0) {
+        rc = cmd_micro();
+    } else if (strcmp(argv[1], "platforms") == 0) {
+        rc = cmd_platforms();
+    } else if (strcmp(argv[1], "adaptive") == 0) {
+        rc = cmd_adaptive();
+    } else if (strcmp(argv[1], "tune") == 0) {
+        rc = cmd_tune();
+    } else if (strcmp(argv[1], "numa") == 0) {
+        rc = cmd_numa();
+    } else if (strcmp(argv[1], "residency") == 0) {
+        rc = cmd_residency();
+    } else if (strcmp(argv[1], "transfer") == 0) {
+        rc = cmd_transfer();
+    } else if (strcmp(argv[1], "oversub") == 0) {
+        rc = cmd_oversub();
+    } else if (strcmp(argv[1], "concurrent") == 0) {
+        rc = cmd_concurrent();
+    } else if (strcmp(argv[1], "neighbors") == 0) {
+        rc = cmd_neighbors();
+    } else if (strcmp(argv[1], "scaling") == 0) {
+        rc = cmd_scaling();
+    } else if (strcmp(argv[1], "jitter") == 0) {
+        rc = cmd_jitter();
+    } else {
+        printf("Unknown command: %s\n", argv[1]);
+        return 1;
+    }
+
+    // Startup cost of the OpenCL runtime, if the command loaded it
+    if (ocl_startup.loaded) {
+        ocl_print_startup(stdout);
+    }
+    return rc;
+}
+
+// Value of --name=value, or def if absent
+const char *opt(const char *name, const char *def) {
+    size_t len = strlen(name);
+    for (int i = 2; i < argc_g; i++) {
+        if (strncmp(argv_g[i], "--", 2) == 0 && strncmp(argv_g[i] + 2, name, len) == 0 && argv_g[i][2 + len] == '=') {
+            return argv_g[i] + 3 + len;
+        }
+    }
+    return def;
+}
+
+// True if --name was given
+bool has_flag(const char *name) {
+    for (int i = 2; i < argc_g; i++) {
+        if (strncmp(argv_g[i], "--", 2) == 0 && strcmp(argv_g[i] + 2, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Integers of a comma-separated list (empty for NULL)
+std::vector<int> int_list(const char *list) {
+    std::vector<int> values;
+    while (list != NULL && *list != '\0') {
+        values.push_back(atoi(list));
+        list = strchr(list, ',');
+        list = list != NULL ? list + 1 : NULL;
+    }
+    return values;
+}
+
+// Run the suite and record or check the per-machine baseline
+int cmd_suite() {
+    ADAPTIVE.min_reps = atoi(opt("min-reps", "5"));
+    ADAPTIVE.max_reps = atoi(opt("max-reps", "1000"));
+    ADAPTIVE.target_rel_ci = atof(opt("ci", "0.02"));
+    ADAPTIVE.budget_s = atof(opt("budget", "2"));
+    double tolerance = atof(opt("tolerance", "0.05"));
+
+    // Baseline files are per machine: default name includes the hostname
+    char default_path[300];
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    snprintf(default_path, sizeof(default_path), "vector_add_baseline.%s.txt", host);
+    const char *path = opt("baseline", default_path);
+
+    std::vector<Result> results;
+    run_suite(results);
+
+    // Record a new baseline if asked to, or if none exists yet
+    std::vector<Result> base;
+    BenchEnv base_env;
+    if (has_flag("update") || !read_baseline(path, base, &base_env)) {
+        write_baseline(path, results);
+        printf("Baseline written to %s (%zu configurations)\n", path, results.size());
+        return 0;
+    }
+
+    printf("Comparing against baseline %s\n", path);
+    if (env_diff(&base_env, &ENV) > 0) {
+        fprintf(stderr, "WARNING: baseline was recorded under different settings; deltas may not be comparable\n");
+    }
+    return compare_results(base, results, tolerance, opt("backends", "openmp,opencl"));
+}
+
+// Run every configuration of the matrix for the selected backends
+void run_suite(std::vector<Result> &results) {
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+    const char *backends = opt("backends", "openmp,opencl");
+    for (const char *type : SUITE_TYPES) {
+        if (strstr(backends, "openmp") != NULL) {
+            if (strcmp(type, "int") == 0) suite_openmp<int>(type, results);
+            if (strcmp(type, "float") == 0) suite_openmp<float>(type, results);
+            if (strcmp(type, "double") == 0) suite_openmp<double>(type, results);
+        }
+        if (strstr(backends, "opencl") != NULL) {
+            if (strcmp(type, "int") == 0) suite_opencl<int>(type, results);
+            if (strcmp(type, "float") == 0) suite_opencl<float>(type, results);
+            if (strcmp(type, "double") == 0) suite_opencl<double>(type, results);
+        }
+    }
+}
+
+// Multi-threaded CPU vector addition using OpenMP with an explicit team size
+template <typename T>
+void vector_add_omp_t(const T *v1, const T *v2, T *v_out, int size, int threads) {
+    #pragma omp parallel for num_threads(threads)
+    for (int i = 0; i < size; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+}
+
+// OpenMP rows of the matrix: every size at thread counts 1, 2, 4, ... and the maximum
+template <typename T>
+void suite_openmp(const char *type, std::vector<Result> &results) {
+    int max_threads = omp_get_max_threads();
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(max_threads);
+
+    for (int size : SUITE_SIZES) {
+        T *v1, *v2, *v_out;
+        init_t(v1, size);
+        init_t(v2, size);
+        init_t(v_out, size);
+
+        for (int threads : thread_counts) {
+            Result r = {"openmp", type, size, threads, 0, 0, 0};
+            measure([&]() { vector_add_omp_t(v1, v2, v_out, size, threads); }, &r);
+            check_t(v1, v2, v_out, size, "openmp");
+            printf("%-7s %-7s %10d %4d  %10.4f ms  %5d reps\n", "openmp", type, size, threads, r.median_ms, r.reps);
+            results.push_back(r);
+        }
+
+        free(v1);
+        free(v2);
+        free(v_out);
+    }
+}
+
+// OpenCL rows of the matrix: kernel time (enqueue + wait) for every size
+template <typename T>
+void suite_opencl(const char *type, std::vector<Result> &results) {
+    OclBackend b;
+    if (!ocl_backend_init(&b, "./vector_ops_ocl.cl", "vector_add_ocl", type)) {
+        fprintf(stderr, "WARNING: OpenCL setup failed, skipping opencl %s rows\n", type);
+        return;
+    }
+    env_capture_opencl(&ENV, b.device);
+
+    for (int size : SUITE_SIZES) {
+        T *v1, *v2, *v_out;
+        init_t(v1, size);
+        init_t(v2, size);
+        init_t(v_out, size);
+
+        // Allocate device buffers and copy inputs once; only the kernel is timed
+        cl_mem bufV1 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, size * sizeof(T), NULL, NULL);
+        cl_mem bufV2 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, size * sizeof(T), NULL, NULL);
+        cl_mem bufV_out = clCreateBuffer(b.context, CL_MEM_READ_WRITE, size * sizeof(T), NULL, NULL);
+        clEnqueueWriteBuffer(b.queue, bufV1, CL_TRUE, 0, size * sizeof(T), v1, 0, NULL, NULL);
+        clEnqueueWriteBuffer(b.queue, bufV2, CL_TRUE, 0, size * sizeof(T), v2, 0, NULL, NULL);
+        clSetKernelArg(b.kernel, 0, sizeof(int), &size);
+        clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufV1);
+        clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufV2);
+        clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufV_out);
+
+        size_t global[1] = {(size_t)size};
+        Result r = {"opencl", type, size, 0, 0, 0, 0};
+        measure([&]() {
+            cl_event event;
+            clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, &event);
+            clWaitForEvents(1, &event);
+            clReleaseEvent(event);
+        }, &r);
+
+        // Verify the result so a broken kernel cannot pass as fast
+        clEnqueueReadBuffer(b.queue, bufV_out, CL_TRUE, 0, size * sizeof(T), v_out, 0, NULL, NULL);
+        check_t(v1, v2, v_out, size, "opencl");
+        printf("%-7s %-7s %10d %4s  %10.4f ms  %5d reps\n", "opencl", type, size, "-", r.median_ms, r.reps);
+        results.push_back(r);
+
+        clReleaseMemObject(bufV1);
+        clReleaseMemObject(bufV2);
+        clReleaseMemObject(bufV_out);
+        free(v1);
+        free(v2);
+        free(v_out);
+    }
+
+    ocl_backend_release(&b);
+}
+
+// Launch-overhead and latency-floor microbenchmarks for both backends
+int cmd_micro() {
+    int reps = atoi(opt("reps", "2000"));
+    const char *backends = opt("backends", "openmp,opencl");
+
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+    printf("%-34s %10s %10s %10s\n", "microbenchmark (us)", "min", "median", "p99");
+    if (strstr(backends, "openmp") != NULL) {
+        micro_openmp(reps);
+    }
+    if (strstr(backends, "opencl") != NULL) {
+        micro_opencl(reps);
+    }
+    return 0;
+}
+
+// Time fn reps times after a short warm-up; returns per-call microseconds
+template <typename F>
+std::vector<double> time_us(F fn, int reps) {
+    for (int i = 0; i < MICRO_WARMUP; i++) {
+        fn();
+    }
+    std::vector<double> us(reps);
+    for (int i = 0; i < reps; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        auto stop = std::chrono::high_resolution_clock::now();
+        us[i] = std::chrono::duration<double, std::micro>(stop - start).count();
+    }
+    return us;
+}
+
+// Print one microbenchmark row
+void print_micro(const char *name, std::vector<double> us) {
+    std::sort(us.begin(), us.end());
+    printf("%-34s %10.3f %10.3f %10.3f\n", name, us.front(), percentile_sorted(us, 50), percentile_sorted(us, 99));
+}
+
+// OpenMP: fork/join cost of an empty region and tiny adds, serial versus parallel
+void micro_openmp(int reps) {
+    int threads = omp_get_max_threads();
+    char name[64];
+
+    // Empty parallel region: pure fork/join cost of the team
+    snprintf(name, sizeof(name), "omp empty region (%d thr)", threads);
+    print_micro(name, time_us([&]() {
+        #pragma omp parallel
+        {
+            asm volatile("" ::: "memory"); // Keep the compiler from dropping the empty region
+        }
+    }, reps));
+
+    int *v1, *v2, *v_out;
+    init_t(v1, 1024);
+    init_t(v2, 1024);
+    init_t(v_out, 1024);
+
+    // Tiny adds: the parallel loop only pays off once it beats the serial loop
+    int crossover = -1;
+    for (int size : MICRO_SIZES) {
+        std::vector<double> serial = time_us([&]() { vector_add_omp_t(v1, v2, v_out, size, 1); }, reps);
+        std::vector<double> parallel = time_us([&]() { vector_add_omp_t(v1, v2, v_out, size, threads); }, reps);
+        snprintf(name, sizeof(name), "omp add n=%d serial", size);
+        print_micro(name, serial);
+        snprintf(name, sizeof(name), "omp add n=%d parallel", size);
+        print_micro(name, parallel);
+        if (crossover < 0 && median(parallel) < median(serial)) {
+            crossover = size;
+        }
+    }
+    if (crossover > 0) {
+        printf("omp: parallel add first beats serial at n=%d\n", crossover);
+    } else {
+        printf("omp: serial add is faster for all n <= %d\n", MICRO_SIZES[sizeof(MICRO_SIZES) / sizeof(int) - 1]);
+    }
+
+    free(v1);
+    free(v2);
+    free(v_out);
+}
+
+// OpenCL: enqueue, wait and round-trip costs of empty and tiny kernels, buffer create/release
+void micro_opencl(int reps) {
+    cl_int err;
+    char name[64];
+    OclBackend b;
+    if (!ocl_backend_init(&b, "./vector_ops_ocl.cl", "vector_add_ocl", NULL)) {
+        fprintf(stderr, "WARNING: OpenCL setup failed, skipping OpenCL measurements\n");
+        return;
+    }
+    env_capture_opencl(&ENV, b.device);
+    env_print(&ENV, stdout);
+    cl_kernel empty = clCreateKernel(b.program, "empty_kernel", &err);
+    if (err < 0) {
+        fprintf(stderr, "WARNING: Couldn't create empty_kernel (error %d), skipping OpenCL measurements\n", err);
+        ocl_backend_release(&b);
+        return;
+    }
+    size_t one[1] = {1};
+
+    // One checked launch per kernel; the timed loops below do not look at return codes
+    auto launches = [&](cl_kernel kernel, size_t *global) {
+        cl_event event;
+        cl_int rc = clEnqueueNDRangeKernel(b.queue, kernel, 1, NULL, global, NULL, 0, NULL, &event);
+        if (rc < 0) {
+            fprintf(stderr, "WARNING: kernel launch failed (error %d), skipping OpenCL measurements\n", rc);
+            return false;
+        }
+        clWaitForEvents(1, &event);
+        clReleaseEvent(event);
+        return true;
+    };
+    if (!launches(empty, one)) {
+        clReleaseKernel(empty);
+        ocl_backend_release(&b);
+        return;
+    }
+
+    // Empty kernel round trip: clEnqueueNDRangeKernel + clWaitForEvents
+    print_micro("ocl empty kernel round trip", time_us([&]() {
+        cl_event event;
+        clEnqueueNDRangeKernel(b.queue, empty, 1, NULL, one, NULL, 0, NULL, &event);
+        clWaitForEvents(1, &event);
+        clReleaseEvent(event);
+    }, reps));
+
+    // Split the round trip: enqueue call alone, then the wait for the same event
+    std::vector<double> enqueue_us(reps), wait_us(reps);
+    for (int i = 0; i < reps; i++) {
+        cl_event event;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        clEnqueueNDRangeKernel(b.queue, empty, 1, NULL, one, NULL, 0, NULL, &event);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        clWaitForEvents(1, &event);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        clReleaseEvent(event);
+        enqueue_us[i] = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        wait_us[i] = std::chrono::duration<double, std::micro>(t2 - t1).count();
+    }
+    print_micro("ocl enqueue (empty kernel)", enqueue_us);
+    print_micro("ocl event wait (empty kernel)", wait_us);
+
+    // Tiny adds on resident buffers, and with the host transfers the demo performs
+    int *v1, *v2, *v_out;
+    init_t(v1, 1024);
+    init_t(v2, 1024);
+    init_t(v_out, 1024);
+    cl_mem bufV1 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, 1024 * sizeof(int), NULL, NULL);
+    cl_mem bufV2 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, 1024 * sizeof(int), NULL, NULL);
+    cl_mem bufV_out = clCreateBuffer(b.context, CL_MEM_READ_WRITE, 1024 * sizeof(int), NULL, NULL);
+    clEnqueueWriteBuffer(b.queue, bufV1, CL_TRUE, 0, 1024 * sizeof(int), v1, 0, NULL, NULL);
+    clEnqueueWriteBuffer(b.queue, bufV2, CL_TRUE, 0, 1024 * sizeof(int), v2, 0, NULL, NULL);
+    clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufV1);
+    clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufV2);
+    clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufV_out);
+    clSetKernelArg(b.kernel, 0, sizeof(int), &MICRO_SIZES[0]);
+    size_t first[1] = {(size_t)MICRO_SIZES[0]};
+    if (!launches(b.kernel, first)) {
+        clReleaseMemObject(bufV1);
+        clReleaseMemObject(bufV2);
+        clReleaseMemObject(bufV_out);
+        clReleaseKernel(empty);
+        ocl_backend_release(&b);
+        free(v1);
+        free(v2);
+        free(v_out);
+        return;
+    }
+    for (int size : MICRO_SIZES) {
+        size_t global[1] = {(size_t)size};
+        clSetKernelArg(b.kernel, 0, sizeof(int), &size);
+        snprintf(name, sizeof(name), "ocl add n=%d", size);
+        print_micro(name, time_us([&]() {
+            cl_event event;
+            clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, &event);
+            clWaitForEvents(1, &event);
+            clReleaseEvent(event);
+        }, reps));
+        snprintf(name, sizeof(name), "ocl add n=%d with transfers", size);
+        print_micro(name, time_us([&]() {
+            clEnqueueWriteBuffer(b.queue, bufV1, CL_FALSE, 0, size * sizeof(int), v1, 0, NULL, NULL);
+            clEnqueueWriteBuffer(b.queue, bufV2, CL_FALSE, 0, size * sizeof(int), v2, 0, NULL, NULL);
+            clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+            clEnqueueReadBuffer(b.queue, bufV_out, CL_TRUE, 0, size * sizeof(int), v_out, 0, NULL, NULL);
+        }, reps));
+    }
+    check_t(v1, v2, v_out, MICRO_SIZES[sizeof(MICRO_SIZES) / sizeof(int) - 1], "opencl");
+
+    // Buffer create/release for a small and a large allocation
+    const size_t buffer_bytes[] = {4096, 1 << 20, 64 << 20};
+    for (size_t bytes : buffer_bytes) {
+        snprintf(name, sizeof(name), "ocl buffer create+release %zuK", bytes >> 10);
+        print_micro(name, time_us([&]() {
+            cl_mem buf = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+            clReleaseMemObject(buf);
+        }, reps));
+    }
+
+    clReleaseMemObject(bufV1);
+    clReleaseMemObject(bufV2);
+    clReleaseMemObject(bufV_out);
+    clReleaseKernel(empty);
+    ocl_backend_release(&b);
+    free(v1);
+    free(v2);
+    free(v_out);
+}
+
+// Compare every installed OpenCL platform/device on the same kernels, sizes and transfer modes
+int cmd_platforms() {
+    const char *types = opt("types", "int,float");
+    const char *modes = opt("modes", "copy,hostptr");
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    std::vector<OclDeviceRef> devices = list_devices();
+    if (devices.empty()) {
+        printf("No OpenCL platforms found\n");
+        return 1;
+    }
+
+    // List what was found; indices match OCL_PLATFORM / OCL_DEVICE
+    for (const OclDeviceRef &ref : devices) {
+        BenchEnv dev_env;
+        env_capture_opencl(&dev_env, ref.device);
+        printf("[%d.%d] %s / %s / %s / driver %s\n", ref.platform_index, ref.device_index,
+               env_get(&dev_env, "ocl_platform").c_str(), env_get(&dev_env, "ocl_device").c_str(),
+               env_get(&dev_env, "ocl_device_version").c_str(), env_get(&dev_env, "ocl_driver").c_str());
+    }
+
+    // Bandwidths in GB/s; transfers move one vector, the kernel moves three
+    printf("%-5s %-7s %10s %9s %9s %9s %9s %9s\n",
+           "dev", "type", "size", "build_ms", "h2d_copy", "d2h_copy", "map_host", "kernel");
+    for (const OclDeviceRef &ref : devices) {
+        for (const char *type : SUITE_TYPES) {
+            if (strstr(types, type) == NULL) {
+                continue;
+            }
+            if (strcmp(type, "int") == 0) platform_rows<int>(ref, type, modes);
+            if (strcmp(type, "float") == 0) platform_rows<float>(ref, type, modes);
+            if (strcmp(type, "double") == 0) platform_rows<double>(ref, type, modes);
+        }
+    }
+    return 0;
+}
+
+// One table row per size for a device and element type
+template <typename T>
+void platform_rows(const OclDeviceRef &ref, const char *type, const char *modes) {
+    OclBackend b;
+    if (!ocl_backend_init_device(&b, ref.device, "./vector_ops_ocl.cl", "vector_add_ocl", type)) {
+        fprintf(stderr, "WARNING: setup failed on platform %d device %d, skipping %s\n",
+                ref.platform_index, ref.device_index, type);
+        return;
+    }
+
+    for (int size : PLATFORM_SIZES) {
+        size_t bytes = size * sizeof(T);
+        T *v1, *v2, *v_out;
+        init_t(v1, size);
+        init_t(v2, size);
+        init_t(v_out, size);
+        double h2d = NAN, d2h = NAN, map_host = NAN;
+
+        cl_mem bufV1 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+        cl_mem bufV2 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+        cl_mem bufV_out = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+
+        // copy: blocking clEnqueueWriteBuffer / clEnqueueReadBuffer from pageable host memory
+        if (strstr(modes, "copy") != NULL) {
+            h2d = bytes / time_median_ms([&]() {
+                clEnqueueWriteBuffer(b.queue, bufV1, CL_TRUE, 0, bytes, v1, 0, NULL, NULL);
+            }) / 1e6;
+            d2h = bytes / time_median_ms([&]() {
+                clEnqueueReadBuffer(b.queue, bufV1, CL_TRUE, 0, bytes, v_out, 0, NULL, NULL);
+            }) / 1e6;
+        }
+
+        // hostptr: buffer wraps the host array (CL_MEM_USE_HOST_PTR), host access by map/unmap
+        if (strstr(modes, "hostptr") != NULL) {
+            cl_mem bufHost = clCreateBuffer(b.context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, bytes, v1, NULL);
+            map_host = bytes / time_median_ms([&]() {
+                void *p = clEnqueueMapBuffer(b.queue, bufHost, CL_TRUE, CL_MAP_READ, 0, bytes, 0, NULL, NULL, NULL);
+                clEnqueueUnmapMemObject(b.queue, bufHost, p, 0, NULL, NULL);
+                clFinish(b.queue);
+            }) / 1e6;
+            clReleaseMemObject(bufHost);
+        }
+
+        // Kernel on resident buffers
+        clEnqueueWriteBuffer(b.queue, bufV1, CL_TRUE, 0, bytes, v1, 0, NULL, NULL);
+        clEnqueueWriteBuffer(b.queue, bufV2, CL_TRUE, 0, bytes, v2, 0, NULL, NULL);
+        clSetKernelArg(b.kernel, 0, sizeof(int), &size);
+        clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufV1);
+        clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufV2);
+        clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufV_out);
+        size_t global[1] = {(size_t)size};
+        double kernel = 3.0 * bytes / time_median_ms([&]() {
+            cl_event event;
+            clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, &event);
+            clWaitForEvents(1, &event);
+            clReleaseEvent(event);
+        }) / 1e6;
+        clEnqueueReadBuffer(b.queue, bufV_out, CL_TRUE, 0, bytes, v_out, 0, NULL, NULL);
+        check_t(v1, v2, v_out, size, "opencl");
+
+        char dev[16];
+        snprintf(dev, sizeof(dev), "%d.%d", ref.platform_index, ref.device_index);
+        printf("%-5s %-7s %10d %9.2f %9.2f %9.2f %9.2f %9.2f\n", dev, type, size, b.build_ms, h2d, d2h, map_host, kernel);
+
+        clReleaseMemObject(bufV1);
+        clReleaseMemObject(bufV2);
+        clReleaseMemObject(bufV_out);
+        free(v1);
+        free(v2);
+        free(v_out);
+    }
+
+    ocl_backend_release(&b);
+}
+
+// Repeated long adds through the adaptive engine, printing throughput and the chosen variant
+int cmd_adaptive() {
+    int size = atoi(opt("size", "67108864"));
+    int iters = atoi(opt("iters", "50"));
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    int *v1, *v2, *v_out;
+    init_t(v1, size);
+    init_t(v2, size);
+    init_t(v_out, size);
+
+    Engine e;
+    engine_init(&e, has_flag("opencl"), stdout);
+    for (int it = 0; it < iters; it++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        engine_vector_add(&e, v1, v2, v_out, size);
+        auto stop = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+        printf("iter %3d: %10.3f ms  %8.2f GB/s  current %s\n", it, ms, 3.0 * size * sizeof(int) / ms / 1e6,
+               e.variants[e.current].name);
+    }
+    check_t(v1, v2, v_out, size, "engine");
+
+    printf("%ld switch(es)\n", e.switches);
+    engine_print_stats(&e, stdout);
+    engine_release(&e);
+    free(v1);
+    free(v2);
+    free(v_out);
+    return 0;
+}
+
+// Autotune the CPU kernel family for this host and record the winners
+int cmd_tune() {
+    char default_path[300];
+    cpu_tuning_path(default_path, sizeof(default_path));
+    const char *path = opt("tuning", default_path);
+    AdaptiveConfig cfg = {5, 200, 0.02, atof(opt("budget", "0.2"))};
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    printf("Tuning %d variants with %d threads\n", NUM_CPU_KERNELS, omp_get_max_threads());
+    cpu_autotune(path, cfg, has_flag("verbose") ? stdout : NULL);
+
+    char name[64];
+    for (int c = 0; c < NUM_CPU_SIZE_CLASSES; c++) {
+        cpu_kernel_name(CPU_TUNED[c], name, sizeof(name));
+        if (c < NUM_CPU_SIZE_CLASSES - 1) {
+            printf("n <= %-10ld %s\n", CPU_SIZE_CLASSES[c], name);
+        } else {
+            printf("n >  %-10ld %s\n", CPU_SIZE_CLASSES[c - 1], name);
+        }
+    }
+    printf("Tuning written to %s\n", path);
+    return 0;
+}
+
+// NUMA placement policies and live page migration for repeated adds
+int cmd_numa() {
+    long size = atol(opt("size", "67108864"));
+    int iters = atoi(opt("iters", "20"));
+    const char *policy_name = opt("policy", "firsttouch");
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    NumaPolicy policy;
+    if (strcmp(policy_name, "firsttouch") == 0) {
+        policy = NUMA_FIRSTTOUCH;
+    } else if (strcmp(policy_name, "interleave") == 0) {
+        policy = NUMA_INTERLEAVE;
+    } else if (strcmp(policy_name, "bind") == 0) {
+        policy = NUMA_BIND;
+    } else {
+        printf("Unknown policy: %s\n", policy_name);
+        return 1;
+    }
+    if (numa_available() < 0) {
+        printf("NUMA not available on this host; placement and migration are no-ops\n");
+    } else {
+        printf("%d NUMA node(s)\n", numa_max_node() + 1);
+    }
+
+    // Thread-to-node map shared by placement, migration and the add loop
+    std::vector<int> thread_nodes = numa_thread_nodes();
+    int threads = (int)thread_nodes.size();
+    for (int t = 0; t < threads; t++) {
+        printf("thread %d -> node %d\n", t, thread_nodes[t]);
+    }
+
+    int *v1 = numa_alloc_vector(size, policy, thread_nodes);
+    int *v2 = numa_alloc_vector(size, policy, thread_nodes);
+    int *v_out = numa_alloc_vector(size, policy, thread_nodes);
+
+    // Data arrives from elsewhere: the main thread writes all of it
+    for (long i = 0; i < size; i++) {
+        v1[i] = rand() % 100;
+        v2[i] = rand() % 100;
+        v_out[i] = 0;
+    }
+    numa_print_placement("v1", v1, size);
+
+    // Per-iteration time with the placement as allocated
+    auto time_iters = [&]() {
+        std::vector<double> ms;
+        numa_vector_add(v1, v2, v_out, size, threads); // Warm up
+        for (int it = 0; it < iters; it++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            numa_vector_add(v1, v2, v_out, size, threads);
+            auto stop = std::chrono::high_resolution_clock::now();
+            ms.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+        return median(ms);
+    };
+    double before_ms = time_iters();
+    printf("policy %s: %.3f ms/iter (%.2f GB/s)\n", policy_name, before_ms, 3.0 * size * sizeof(int) / before_ms / 1e6);
+
+    // Optionally migrate every thread's chunk to its node and compare
+    if (has_flag("migrate")) {
+        auto start = std::chrono::high_resolution_clock::now();
+        long failed[3];
+        long pages = numa_migrate_chunks(v1, size, thread_nodes, &failed[0]);
+        pages += numa_migrate_chunks(v2, size, thread_nodes, &failed[1]);
+        pages += numa_migrate_chunks(v_out, size, thread_nodes, &failed[2]);
+        long stayed = failed[0] + failed[1] + failed[2];
+        auto stop = std::chrono::high_resolution_clock::now();
+        double migrate_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+        numa_print_placement("v1", v1, size);
+
+        double after_ms = time_iters();
+        double gain = before_ms - after_ms;
+        printf("migration: %ld pages in %.3f ms; %.3f ms/iter after (gain %.3f ms/iter)\n", pages, migrate_ms, after_ms, gain);
+        if (stayed > 0) {
+            printf("%ld remote pages could not be moved (shared with another process, or move_pages failed)\n", stayed);
+        }
+        if (pages == 0 && stayed == 0) {
+            printf("all pages were already local; nothing to migrate\n");
+        } else if (pages == 0) {
+            printf("no pages were moved\n");
+        } else if (gain > 0) {
+            printf("migration pays off after %.1f iterations\n", migrate_ms / gain);
+        } else {
+            printf("migration does not pay off\n");
+        }
+    }
+    check_t(v1, v2, v_out, (int)size, "numa");
+
+    numa_free_vector(v1, size);
+    numa_free_vector(v2, size);
+    numa_free_vector(v_out, size);
+    return 0;
+}
+
+// Chain of OpenCL adds with eager copies versus residency-tracked vectors
+int cmd_residency() {
+    int size = atoi(opt("size", "16777216"));
+    int ops = atoi(opt("ops", "8"));
+    const int edit = 1024; // Elements of v1 the host changes midway through the chain
+    size_t bytes = size * sizeof(int);
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    OclBackend b;
+    if (!ocl_backend_init(&b, "./vector_ops_ocl.cl", "vector_add_ocl", NULL)) {
+        fprintf(stderr, "residency needs a working OpenCL device\n");
+        return 1;
+    }
+    env_capture_opencl(&ENV, b.device);
+
+    // Each flow gets its own copy of v1 because both apply the same host edit
+    int *v1_naive, *v1_managed, *v2, *t_naive, *t_managed;
+    init_t(v1_naive, size);
+    init_t(v2, size);
+    init_t(t_naive, size);
+    init_t(t_managed, size);
+    v1_managed = (int *)malloc(bytes);
+    memcpy(v1_managed, v1_naive, bytes);
+
+    // Eager flow: write both inputs, run, read the output, for every op
+    cl_mem bufA = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    cl_mem bufB = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    cl_mem bufOut = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    size_t global[1] = {(size_t)size};
+    long naive_bytes = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < ops; k++) {
+        if (k == ops / 2) {
+            for (int i = 0; i < edit; i++) v1_naive[i] += 1;
+        }
+        clEnqueueWriteBuffer(b.queue, bufA, CL_TRUE, 0, bytes, v1_naive, 0, NULL, NULL);
+        clEnqueueWriteBuffer(b.queue, bufB, CL_TRUE, 0, bytes, k == 0 ? v2 : t_naive, 0, NULL, NULL);
+        clSetKernelArg(b.kernel, 0, sizeof(int), &size);
+        clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufA);
+        clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufB);
+        clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufOut);
+        clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+        clEnqueueReadBuffer(b.queue, bufOut, CL_TRUE, 0, bytes, t_naive, 0, NULL, NULL);
+        naive_bytes += 3 * bytes;
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    double naive_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    clReleaseMemObject(bufA);
+    clReleaseMemObject(bufB);
+    clReleaseMemObject(bufOut);
+
+    // Residency-tracked flow: t stays on the device, v1 is uploaded once plus the edited range
+    DeviceVector dv1, dv2, dt;
+    dv_create(&dv1, b.context, v1_managed, size);
+    dv_create(&dv2, b.context, v2, size);
+    dv_create(&dt, b.context, t_managed, size);
+    start = std::chrono::high_resolution_clock::now();
+    for (int k = 0; k < ops; k++) {
+        if (k == ops / 2) {
+            dv_host_write(&dv1, b.queue, 0, edit);
+            for (int i = 0; i < edit; i++) v1_managed[i] += 1;
+        }
+        dv_vector_add(b.queue, b.kernel, &dv1, k == 0 ? &dv2 : &dt, &dt);
+    }
+    dv_host_read(&dt, b.queue);
+    stop = std::chrono::high_resolution_clock::now();
+    double managed_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    long managed_bytes = dv1.bytes_h2d + dv2.bytes_h2d + dt.bytes_h2d + dv1.bytes_d2h + dv2.bytes_d2h + dt.bytes_d2h;
+
+    if (memcmp(t_naive, t_managed, bytes) != 0) {
+        printf("Residency-tracked result differs from the eager result\n");
+        exit(1);
+    }
+    printf("%d chained adds of %d elements\n", ops, size);
+    printf("eager copies:      %10.3f ms  %8.1f MB transferred\n", naive_ms, naive_bytes / 1e6);
+    printf("residency tracked: %10.3f ms  %8.1f MB transferred\n", managed_ms, managed_bytes / 1e6);
+
+    dv_release(&dv1);
+    dv_release(&dv2);
+    dv_release(&dt);
+    ocl_backend_release(&b);
+    free(v1_naive);
+    free(v1_managed);
+    free(v2);
+    free(t_naive);
+    free(t_managed);
+    return 0;
+}
+
+// Transfer bandwidth and end-to-end time of one add for every transfer mode
+int cmd_transfer() {
+    int size = atoi(opt("size", "16777216"));
+    const char *modes = opt("modes", "pageable,mlock,pinned,migrate");
+    size_t bytes = size * sizeof(int);
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    OclBackend b;
+    if (!ocl_backend_init(&b, "./vector_ops_ocl.cl", "vector_add_ocl", NULL)) {
+        fprintf(stderr, "transfer needs a working OpenCL device\n");
+        return 1;
+    }
+    env_capture_opencl(&ENV, b.device);
+
+    int *v1, *v2, *v_out;
+    init_t(v1, size);
+    init_t(v2, size);
+    init_t(v_out, size);
+    cl_mem bufV1 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    cl_mem bufV2 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    cl_mem bufV_out = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    clSetKernelArg(b.kernel, 0, sizeof(int), &size);
+    clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufV1);
+    clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufV2);
+    clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufV_out);
+    size_t global[1] = {(size_t)size};
+
+    // Bandwidths in GB/s; h2d moves both inputs, d2h the output
+    printf("%-9s %10s %9s %9s %10s\n", "mode", "size", "h2d", "d2h", "total_ms");
+    for (int m = 0; m < 4; m++) {
+        if (strstr(modes, TRANSFER_MODE_NAMES[m]) == NULL) {
+            continue;
+        }
+        OclTransfer t;
+        xfer_init(&t, b.context, b.queue, (TransferMode)m);
+        bool ok = true;
+        auto upload = [&]() {
+            ok = xfer_upload(&t, bufV1, v1, bytes) && xfer_upload(&t, bufV2, v2, bytes) && ok;
+            xfer_output(&t, bufV_out);
+            xfer_finish(&t);
+        };
+        double h2d = 2.0 * bytes / time_median_ms(upload) / 1e6;
+        double d2h = bytes / time_median_ms([&]() {
+            ok = xfer_download(&t, bufV_out, v_out, bytes) && ok;
+        }) / 1e6;
+        double total_ms = time_median_ms([&]() {
+            upload();
+            clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+            ok = xfer_download(&t, bufV_out, v_out, bytes) && ok;
+        });
+        if (!ok) {
+            printf("%-9s setup failed\n", TRANSFER_MODE_NAMES[m]);
+            xfer_release(&t);
+            continue;
+        }
+        check_t(v1, v2, v_out, size, TRANSFER_MODE_NAMES[m]);
+        printf("%-9s %10d %9.2f %9.2f %10.3f\n", TRANSFER_MODE_NAMES[m], size, h2d, d2h, total_ms);
+        xfer_release(&t);
+    }
+
+    clReleaseMemObject(bufV1);
+    clReleaseMemObject(bufV2);
+    clReleaseMemObject(bufV_out);
+    ocl_backend_release(&b);
+    free(v1);
+    free(v2);
+    free(v_out);
+    return 0;
+}
+
+// One co-executed add case of cmd_oversub (runs in its own process)
+int oversub_case(bool coordinated, int size, double share) {
+    CpuBudget cb;
+    cpu_budget_plan(&cb, share);
+    if (coordinated) {
+        cpu_budget_limit_opencl(&cb);
+    }
+    int omp_threads = coordinated ? cb.omp_threads : cb.total;
+
+    // First OpenCL CPU device; with coordination, a sub-device of ocl_units compute units
+    cl_device_id dev = NULL;
+    for (const OclDeviceRef &ref : list_devices()) {
+        cl_device_type type = 0;
+        clGetDeviceInfo(ref.device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+        if (type & CL_DEVICE_TYPE_CPU) {
+            dev = ref.device;
+            break;
+        }
+    }
+    if (dev == NULL) {
+        fprintf(stderr, "oversub needs an OpenCL CPU device\n");
+        return 1;
+    }
+    cl_device_id sub = coordinated ? cpu_budget_subdevice(dev, cb.ocl_units) : NULL;
+    OclBackend b;
+    if (!ocl_backend_init_device(&b, sub != NULL ? sub : dev, "./vector_ops_ocl.cl", "vector_add_ocl", NULL)) {
+        return 1;
+    }
+    cl_uint units = 0;
+    clGetDeviceInfo(b.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+
+    // OpenCL takes [0, split), OpenMP [split, size); inputs are resident before timing
+    int split = (int)(size * share);
+    int *v1, *v2, *v_out;
+    init_t(v1, size);
+    init_t(v2, size);
+    init_t(v_out, size);
+    size_t bytes = split * sizeof(int);
+    cl_mem bufV1 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    cl_mem bufV2 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    cl_mem bufV_out = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    clEnqueueWriteBuffer(b.queue, bufV1, CL_TRUE, 0, bytes, v1, 0, NULL, NULL);
+    clEnqueueWriteBuffer(b.queue, bufV2, CL_TRUE, 0, bytes, v2, 0, NULL, NULL);
+    clSetKernelArg(b.kernel, 0, sizeof(int), &split);
+    clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufV1);
+    clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufV2);
+    clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufV_out);
+    size_t global[1] = {(size_t)split};
+
+    // Both halves run at once: kernel submitted first, OpenMP loop, then wait for the kernel
+    double ms = time_median_ms([&]() {
+        clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+        clFlush(b.queue);
+        #pragma omp parallel for num_threads(omp_threads)
+        for (int i = split; i < size; i++) {
+            v_out[i] = v1[i] + v2[i];
+        }
+        clFinish(b.queue);
+    });
+    clEnqueueReadBuffer(b.queue, bufV_out, CL_TRUE, 0, bytes, v_out, 0, NULL, NULL);
+    check_t(v1, v2, v_out, size, "co-execution");
+
+    const char *limit = !coordinated ? "none" : sub != NULL ? "fission" : "env";
+    printf("%-13s %8d %9u %-8s %10.3f %9.2f\n", coordinated ? "coordinated" : "uncoordinated",
+           omp_threads, units, limit, ms, 3.0 * size * sizeof(int) / ms / 1e6);
+
+    clReleaseMemObject(bufV1);
+    clReleaseMemObject(bufV2);
+    clReleaseMemObject(bufV_out);
+    ocl_backend_release(&b);
+    if (sub != NULL) {
+        clReleaseDevice(sub);
+    }
+    free(v1);
+    free(v2);
+    free(v_out);
+    return 0;
+}
+
+// Co-executed OpenMP + OpenCL CPU add with and without a shared CPU budget
+int cmd_oversub() {
+    int size = atoi(opt("size", "16777216"));
+    double share = atof(opt("ocl-share", "0.5"));
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    // Bandwidth in GB/s over the whole vector; units are the OpenCL device's compute units
+    printf("%-13s %8s %9s %-8s %10s %9s\n", "mode", "omp_thr", "ocl_units", "limit", "ms", "GB/s");
+    int rc = 0;
+    for (int coordinated = 0; coordinated < 2; coordinated++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("Couldn't fork");
+            return 1;
+        }
+        if (pid == 0) {
+            int child_rc = oversub_case(coordinated, size, share);
+            if (ocl_startup.loaded) {
+                ocl_print_startup(stdout);
+            }
+            fflush(stdout);
+            _exit(child_rc);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+// Concurrent callers through per-call OpenMP teams, the shared pool and per-call OpenCL queues
+int cmd_concurrent() {
+    int jobs = atoi(opt("jobs", "4"));
+    int size = atoi(opt("size", "4194304"));
+    int small = atoi(opt("small", "65536"));
+    int iters = atoi(opt("iters", "20"));
+    bool use_opencl = has_flag("opencl");
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    // Every caller owns its vectors; caller 0 issues the small calls
+    std::vector<int *> v1(jobs), v2(jobs), v_out(jobs);
+    for (int j = 0; j < jobs; j++) {
+        int n = j == 0 ? small : size;
+        init_t(v1[j], n);
+        init_t(v2[j], n);
+        init_t(v_out[j], n);
+    }
+
+    WorkerPool pool;
+    pool_start(&pool, 0, POOL_CHUNK);
+    if (has_flag("bw-cap")) {
+        pool_calibrate(&pool, size, stdout);
+    }
+    OclBackend shared;
+    bool have_ocl = use_opencl && ocl_backend_init(&shared, "./vector_ops_ocl.cl", "vector_add_ocl", NULL);
+    if (use_opencl && !have_ocl) {
+        fprintf(stderr, "WARNING: OpenCL setup failed, skipping the opencl mode\n");
+    }
+
+    // Bandwidth in GB/s over all calls; latencies in ms
+    printf("%-7s %5s %9s %10s %10s %10s %10s\n", "mode", "jobs", "GB/s", "p50_ms", "p99_ms",
+           "small_p50", "small_p99");
+    const char *modes[] = {"omp", "pool", "opencl"};
+    for (int m = 0; m < 3; m++) {
+        if (m == 2 && !have_ocl) {
+            continue;
+        }
+        std::vector<std::vector<double>> lat;
+        double wall_ms = run_jobs(jobs, iters, false, lat, [&](int j) {
+            int n = j == 0 ? small : size;
+            if (m == 0) {
+                // What an unmodified caller does: its own OpenMP team per call
+                #pragma omp parallel for
+                for (int i = 0; i < n; i++) {
+                    v_out[j][i] = v1[j][i] + v2[j][i];
+                }
+            } else if (m == 1) {
+                pool_vector_add(&pool, v1[j], v2[j], v_out[j], n);
+            } else {
+                return pool_vector_add_ocl(&shared, v1[j], v2[j], v_out[j], n);
+            }
+            return true;
+        });
+        if (wall_ms < 0) {
+            printf("%-7s failed\n", modes[m]);
+            continue;
+        }
+
+        std::vector<double> large;
+        for (int j = 1; j < jobs; j++) {
+            large.insert(large.end(), lat[j].begin(), lat[j].end());
+            check_t(v1[j], v2[j], v_out[j], size, modes[m]);
+        }
+        check_t(v1[0], v2[0], v_out[0], small, modes[m]);
+        double bytes = 3.0 * sizeof(int) * iters * ((double)small + (double)size * (jobs - 1));
+        printf("%-7s %5d %9.2f %10.3f %10.3f %10.3f %10.3f\n", modes[m], jobs, bytes / wall_ms / 1e6,
+               percentile(large, 50), percentile(large, 99), percentile(lat[0], 50), percentile(lat[0], 99));
+    }
+
+    pool_stop(&pool);
+    if (have_ocl) {
+        ocl_backend_release(&shared);
+    }
+    for (int j = 0; j < jobs; j++) {
+        free(v1[j]);
+        free(v2[j]);
+        free(v_out[j]);
+    }
+    return 0;
+}
+
+// OpenMP and OpenCL add throughput next to bandwidth and cache antagonists
+int cmd_neighbors() {
+    int size = atoi(opt("size", "16777216"));
+    int threads = atoi(opt("threads", "0"));
+    threads = threads > 0 ? threads : omp_get_max_threads();
+    long ant_mb = atol(opt("ant-mb", "64"));
+    if (ant_mb <= 0) {
+        fprintf(stderr, "--ant-mb needs a buffer size in MB >= 1\n");
+        return 1;
+    }
+    long ant_bytes = ant_mb << 20;
+    std::vector<int> counts = int_list(opt("counts", "1,2,4"));
+    int most = 0;
+    for (int c : counts) {
+        most = c > most ? c : most;
+        if (c < 0) {
+            most = -1;
+            break;
+        }
+    }
+    if (counts.empty() || most < 0) {
+        fprintf(stderr, "--counts needs a list of antagonist counts >= 0, like 1,2,4\n");
+        return 1;
+    }
+    std::vector<int> ant_cpus = antagonist_cpu_list(opt("ant-cpus", NULL));
+    const char *ant_node = opt("ant-node", NULL);
+    if (ant_node != NULL) {
+        ant_cpus = antagonist_node_cpus(atoi(ant_node));
+        if (ant_cpus.empty()) {
+            fprintf(stderr, "No CPUs found for node %s\n", ant_node);
+            return 1;
+        }
+    }
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+    cpu_set_t allowed;
+    long cpus = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT(&allowed) : 1;
+    if (threads + most > cpus) {
+        fprintf(stderr, "WARNING: %d OpenMP threads plus %d antagonists on %ld CPUs also measures CPU sharing, "
+                "not only memory interference\n", threads, most, cpus);
+    }
+
+    int *v1, *v2, *v_out;
+    init_t(v1, size);
+    init_t(v2, size);
+    init_t(v_out, size);
+    size_t bytes = size * sizeof(int);
+
+    // Kernel-only OpenCL timing, inputs resident as in the suite
+    OclBackend b;
+    bool have_ocl = has_flag("opencl") && ocl_backend_init(&b, "./vector_ops_ocl.cl", "vector_add_ocl", NULL);
+    if (has_flag("opencl") && !have_ocl) {
+        fprintf(stderr, "WARNING: OpenCL setup failed, skipping the opencl columns\n");
+    }
+    cl_mem bufV1 = NULL, bufV2 = NULL, bufV_out = NULL;
+    size_t global[1] = {(size_t)size};
+    if (have_ocl) {
+        env_capture_opencl(&ENV, b.device);
+        bufV1 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+        bufV2 = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+        bufV_out = clCreateBuffer(b.context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+        clEnqueueWriteBuffer(b.queue, bufV1, CL_TRUE, 0, bytes, v1, 0, NULL, NULL);
+        clEnqueueWriteBuffer(b.queue, bufV2, CL_TRUE, 0, bytes, v2, 0, NULL, NULL);
+        clSetKernelArg(b.kernel, 0, sizeof(int), &size);
+        clSetKernelArg(b.kernel, 1, sizeof(cl_mem), &bufV1);
+        clSetKernelArg(b.kernel, 2, sizeof(cl_mem), &bufV2);
+        clSetKernelArg(b.kernel, 3, sizeof(cl_mem), &bufV_out);
+    }
+
+    // Bandwidths in GB/s, slowdown against the first (quiet) row; ant_GB/s is what the
+    // antagonists moved meanwhile
+    printf("%-10s %5s %9s %8s %9s %8s %10s\n", "antagonist", "count", "omp_GB/s", "omp_slow", "ocl_GB/s", "ocl_slow",
+           "ant_GB/s");
+    double quiet_omp = 0, quiet_ocl = 0;
+    std::vector<std::pair<int, int>> cases = {{-1, 0}};
+    for (const char *k = opt("kinds", "bandwidth,cache"); k != NULL; k = strchr(k, ',') ? strchr(k, ',') + 1 : NULL) {
+        std::string name(k, strcspn(k, ","));
+        int kind = antagonist_parse(name.c_str());
+        if (kind < 0) {
+            fprintf(stderr, "Unknown antagonist kind: %s\n", name.c_str());
+            return 1;
+        }
+        for (int c : counts) {
+            cases.push_back({kind, c});
+        }
+    }
+    int rc = 0;
+    for (const std::pair<int, int> &c : cases) {
+        Antagonist ant;
+        if (c.first >= 0) {
+            if (!antagonist_start(&ant, (AntagonistKind)c.first, c.second, ant_cpus, ant_bytes)) {
+                rc = 1;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Buffers touched, load steady
+        }
+        long ant_start = ant.bytes;
+        auto start = std::chrono::steady_clock::now();
+        double omp_ms = time_median_ms([&]() { vector_add_omp_t(v1, v2, v_out, size, threads); });
+        check_t(v1, v2, v_out, size, "openmp");
+        double ocl_ms = NAN;
+        if (have_ocl) {
+            ocl_ms = time_median_ms([&]() {
+                cl_event event;
+                clEnqueueNDRangeKernel(b.queue, b.kernel, 1, NULL, global, NULL, 0, NULL, &event);
+                clWaitForEvents(1, &event);
+                clReleaseEvent(event);
+            });
+        }
+        double window_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double ant_gbs = (ant.bytes - ant_start) / window_ms / 1e6;
+        if (c.first >= 0) {
+            antagonist_stop(&ant);
+        }
+
+        double omp_gbs = 3.0 * bytes / omp_ms / 1e6;
+        double ocl_gbs = 3.0 * bytes / ocl_ms / 1e6;
+        if (c.first < 0) {
+            quiet_omp = omp_gbs;
+            quiet_ocl = ocl_gbs;
+        }
+        printf("%-10s %5d %9.2f %7.1f%% ", c.first < 0 ? "none" : ANTAGONIST_NAMES[c.first], c.second, omp_gbs,
+               100.0 * (1 - omp_gbs / quiet_omp));
+        if (have_ocl) {
+            printf("%9.2f %7.1f%% ", ocl_gbs, 100.0 * (1 - ocl_gbs / quiet_ocl));
+        } else {
+            printf("%9s %8s ", "-", "-");
+        }
+        printf("%10.2f\n", ant_gbs);
+        fflush(stdout);
+    }
+
+    if (have_ocl) {
+        clEnqueueReadBuffer(b.queue, bufV_out, CL_TRUE, 0, bytes, v_out, 0, NULL, NULL);
+        check_t(v1, v2, v_out, size, "opencl");
+        clReleaseMemObject(bufV1);
+        clReleaseMemObject(bufV2);
+        clReleaseMemObject(bufV_out);
+        ocl_backend_release(&b);
+    }
+    free(v1);
+    free(v2);
+    free(v_out);
+    return rc;
+}
+
+// M concurrent jobs with different threads-per-job splits against the same jobs run serially
+int cmd_scaling() {
+    int size = atoi(opt("size", "10000000"));
+    int iters = atoi(opt("iters", "5"));
+    int total = omp_get_max_threads();
+    std::vector<int> job_counts = int_list(opt("jobs", "1,2,4,8"));
+    std::vector<int> tpj = int_list(opt("tpj", NULL));
+    if (opt("tpj", NULL) == NULL) {
+        for (int t = 1; t < total; t *= 2) {
+            tpj.push_back(t);
+        }
+        tpj.push_back(total);
+    }
+    int max_jobs = 0;
+    for (int n : job_counts) {
+        max_jobs = n > max_jobs ? n : max_jobs;
+        if (n <= 0) {
+            max_jobs = 0;
+            break;
+        }
+    }
+    int min_tpj = tpj.empty() ? 0 : *std::min_element(tpj.begin(), tpj.end());
+    if (max_jobs <= 0 || min_tpj <= 0) {
+        fprintf(stderr, "--jobs and --tpj need lists of counts >= 1, like 1,2,4,8\n");
+        return 1;
+    }
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    std::vector<int *> v1(max_jobs), v2(max_jobs), v_out(max_jobs);
+    for (int j = 0; j < max_jobs; j++) {
+        init_t(v1[j], size);
+        init_t(v2[j], size);
+        init_t(v_out[j], size);
+    }
+    WorkerPool pool;
+    pool_start(&pool, total, POOL_CHUNK);
+    OclBackend shared;
+    bool have_ocl = has_flag("opencl") && ocl_backend_init(&shared, "./vector_ops_ocl.cl", "vector_add_ocl", NULL);
+    if (has_flag("opencl") && !have_ocl) {
+        fprintf(stderr, "WARNING: OpenCL setup failed, skipping the opencl mode\n");
+    }
+
+    // Per-add latencies of all jobs of the last run_jobs(), in one list
+    std::vector<std::vector<double>> per_job;
+    std::vector<double> lat;
+    auto flatten = [&]() {
+        lat.clear();
+        for (const std::vector<double> &l : per_job) {
+            lat.insert(lat.end(), l.begin(), l.end());
+        }
+    };
+
+    // Untimed serial pass so the first row does not pay for thread start-up
+    run_jobs(max_jobs, iters, true, per_job, [&](int j) { vector_add_omp_t(v1[j], v2[j], v_out[j], size, total); return true; });
+
+    // Bandwidth in GB/s over all jobs; vs_serial is the serial makespan over this one
+    printf("%-7s %5s %5s %9s %12s %10s %10s %10s\n", "mode", "jobs", "tpj", "GB/s", "makespan_ms", "vs_serial",
+           "p50_ms", "p99_ms");
+    for (int jobs : job_counts) {
+        double bytes = 3.0 * sizeof(int) * size * iters * jobs;
+        double serial_ms = 0;
+        auto row = [&](const char *mode, int threads, double ms) {
+            flatten();
+            char tpj_text[16] = "-";
+            if (threads > 0) {
+                snprintf(tpj_text, sizeof(tpj_text), "%d", threads);
+            }
+            printf("%-7s %5d %5s %9.2f %12.2f %9.2fx %10.3f %10.3f\n", mode, jobs, tpj_text, bytes / ms / 1e6, ms,
+                   serial_ms / ms, percentile(lat, 50), percentile(lat, 99));
+            fflush(stdout);
+        };
+
+        serial_ms = run_jobs(jobs, iters, true, per_job, [&](int j) {
+            vector_add_omp_t(v1[j], v2[j], v_out[j], size, total);
+            return true;
+        });
+        row("serial", total, serial_ms);
+        for (int threads : tpj) {
+            double ms = run_jobs(jobs, iters, false, per_job, [&](int j) {
+                vector_add_omp_t(v1[j], v2[j], v_out[j], size, threads);
+                return true;
+            });
+            row("omp", threads, ms);
+        }
+        double ms = run_jobs(jobs, iters, false, per_job, [&](int j) {
+            pool_vector_add(&pool, v1[j], v2[j], v_out[j], size);
+            return true;
+        });
+        row("pool", 0, ms);
+        if (have_ocl) {
+            ms = run_jobs(jobs, iters, false, per_job, [&](int j) {
+                return pool_vector_add_ocl(&shared, v1[j], v2[j], v_out[j], size);
+            });
+            if (ms >= 0) {
+                row("opencl", 0, ms);
+            } else {
+                printf("%-7s %5d failed\n", "opencl", jobs);
+            }
+        }
+        for (int j = 0; j < jobs; j++) {
+            check_t(v1[j], v2[j], v_out[j], size, "scaling");
+        }
+    }
+
+    pool_stop(&pool);
+    if (have_ocl) {
+        ocl_backend_release(&shared);
+    }
+    for (int j = 0; j < max_jobs; j++) {
+        free(v1[j]);
+        free(v2[j]);
+        free(v_out[j]);
+    }
+    return 0;
+}
+
+// Per-add latency distribution as an ordinary process and in low-jitter mode
+int cmd_jitter() {
+    int size = atoi(opt("size", "65536"));
+    int iters = atoi(opt("iters", "20000"));
+    int fifo = atoi(opt("fifo", "0"));
+    env_print(&ENV, stdout);
+    env_warn(&ENV);
+
+    // CPUs for the low-jitter team: --cpus, else the isolated ones, else the allowed ones
+    std::vector<int> cpus = antagonist_cpu_list(opt("cpus", NULL));
+    if (cpus.empty()) {
+        cpus = rt_isolated_cpus();
+        if (cpus.empty()) {
+            fprintf(stderr, "WARNING: no isolated CPUs (isolcpus=/nohz_full=); pinning to the allowed CPUs\n");
+            cpu_set_t set;
+            if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+                for (int c = 0; c < CPU_SETSIZE; c++) {
+                    if (CPU_ISSET(c, &set)) {
+                        cpus.push_back(c);
+                    }
+                }
+            }
+        }
+    }
+    int threads = atoi(opt("threads", "0"));
+    threads = threads > 0 ? threads : (int)cpus.size();
+    if (fifo > 0 && threads > (int)cpus.size()) {
+        // Two spinning SCHED_FIFO threads on one CPU can starve each other
+        fprintf(stderr, "--fifo needs at most one thread per CPU: %d threads on %zu CPUs\n", threads, cpus.size());
+        return 1;
+    }
+    printf("low-jitter team: %d thread(s) on CPUs", threads);
+    for (size_t i = 0; i < cpus.size() && (int)i < threads; i++) {
+        printf(" %d", cpus[i]);
+    }
+    printf("%s\n", fifo > 0 ? ", SCHED_FIFO" : "");
+
+    // Latencies in us; faults and involuntary switches counted over the timed loop
+    printf("%-9s %9s %9s %9s %9s %9s %9s %8s %8s\n", "mode", "p50_us", "p99_us", "p99.9_us", "max_us", "stddev",
+           "jitter", "minflt", "nivcsw");
+    for (int rt = 0; rt < 2; rt++) {
+        if (rt == 1) {
+            rt_lock_memory();
+            rt_pin_team(cpus, threads, fifo);
+        }
+        // Fresh vectors each run: the ordinary run faults its pages in during the loop
+        int *v1, *v2;
+        init_t(v1, size);
+        init_t(v2, size);
+        int *v_out = (int *)malloc(sizeof(int) * size);
+        if (rt == 1) {
+            rt_prefault(v_out, sizeof(int) * size);
+        }
+        std::vector<double> us(iters);
+        struct rusage before, after;
+        getrusage(RUSAGE_SELF, &before);
+        for (int it = 0; it < iters; it++) {
+            auto start = std::chrono::steady_clock::now();
+            vector_add_omp_t(v1, v2, v_out, size, threads); // Same team size in both runs
+            auto stop = std::chrono::steady_clock::now();
+            us[it] = std::chrono::duration<double, std::micro>(stop - start).count();
+        }
+        getrusage(RUSAGE_SELF, &after);
+        check_t(v1, v2, v_out, size, "jitter");
+
+        double mean = 0, var = 0;
+        for (double x : us) {
+            mean += x / iters;
+        }
+        for (double x : us) {
+            var += (x - mean) * (x - mean) / iters;
+        }
+        std::sort(us.begin(), us.end());
+        double p50 = percentile_sorted(us, 50);
+        printf("%-9s %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %8ld %8ld\n", rt == 0 ? "ordinary" : "lowjitter", p50,
+               percentile_sorted(us, 99), percentile_sorted(us, 99.9), us.back(), sqrt(var),
+               percentile_sorted(us, 99.9) - p50, after.ru_minflt - before.ru_minflt,
+               after.ru_nivcsw - before.ru_nivcsw);
+        free(v1);
+        free(v2);
+        free(v_out);
+    }
+    printf("jitter = p99.9 - p50\n");
+    munlockall();
+    return 0;
+}
+
+// Median milliseconds of run_once after warm-up, repeating adaptively
+template <typename F>
+double time_median_ms(F run_once) {
+    for (int i = 0; i < WARMUP_REPS; i++) {
+        run_once();
+    }
+    return measure_adaptive([&]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        run_once();
+        auto stop = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }, ADAPTIVE).median;
+}
+
+// Time run_once after warm-up, repeating adaptively; fills median/MAD in milliseconds and reps
+template <typename F>
+void measure(F run_once, Result *r) {
+    for (int i = 0; i < WARMUP_REPS; i++) {
+        run_once();
+    }
+    AdaptiveResult a = measure_adaptive([&]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        run_once();
+        auto stop = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(stop - start).count();
+    }, ADAPTIVE);
+    if (!a.converged) {
+        fprintf(stderr, "WARNING: %s %s n=%d: CI of the median is %.1f%% wide after %d reps\n",
+                r->backend.c_str(), r->type.c_str(), r->size, 100.0 * (a.ci_hi - a.ci_lo) / a.median, a.reps);
+    }
+    r->median_ms = a.median;
+    r->mad_ms = a.mad;
+    r->reps = a.reps;
+}
+
+// Run jobs callers, each calling add(j) iters times: all at once on their own threads, or one
+// after another if serial. Fills lat[j] with caller j's per-call milliseconds and returns the
+// makespan in ms, or -1 if any call returned false.
+template <typename F>
+double run_jobs(int jobs, int iters, bool serial, std::vector<std::vector<double>> &lat, F add) {
+    lat.assign(jobs, std::vector<double>());
+    std::atomic<bool> ok(true); // Cleared by any caller whose add fails
+    auto job = [&](int j) {
+        for (int it = 0; it < iters; it++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            if (!add(j)) {
+                ok = false;
+            }
+            auto stop = std::chrono::high_resolution_clock::now();
+            lat[j].push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+    };
+    auto start = std::chrono::high_resolution_clock::now();
+    if (serial) {
+        for (int j = 0; j < jobs; j++) {
+            job(j);
+        }
+    } else {
+        std::vector<std::thread> threads;
+        for (int j = 0; j < jobs; j++) {
+            threads.emplace_back(job, j);
+        }
+        for (std::thread &t : threads) {
+            t.join();
+        }
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    return ok ? std::chrono::duration<double, std::milli>(stop - start).count() : -1;
+}
+
+// Baseline file: the environment record, then one "backend type size threads median_ms mad_ms reps"
+// line per configuration
+void write_baseline(const char *path, const std::vector<Result> &results) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Couldn't write the baseline file");
+        exit(1);
+    }
+    env_print(&ENV, f);
+    fprintf(f, "# backend type size threads median_ms mad_ms reps\n");
+    for (const Result &r : results) {
+        fprintf(f, "%s %s %d %d %.6f %.6f %d\n", r.backend.c_str(), r.type.c_str(), r.size, r.threads, r.median_ms, r.mad_ms, r.reps);
+    }
+    fclose(f);
+}
+
+// Read a baseline file; returns false if it does not exist
+bool read_baseline(const char *path, std::vector<Result> &results, BenchEnv *env) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    // The env record is one line of arbitrary length: read whole lines
+    char *buf = NULL;
+    size_t cap = 0;
+    while (getline(&buf, &cap, f) != -1) {
+        std::string line = buf;
+        if (line[0] == '#') {
+            env_parse(env, line.c_str());
+            continue;
+        }
+        char backend[32], type[32];
+        Result r;
+        r.reps = 0;
+        if (sscanf(line.c_str(), "%31s %31s %d %d %lf %lf %d", backend, type, &r.size, &r.threads, &r.median_ms, &r.mad_ms, &r.reps) >= 6) {
+            r.backend = backend;
+            r.type = type;
+            results.push_back(r);
+        }
+    }
+    free(buf);
+    fclose(f);
+    return true;
+}
+
+// Print the diff table; returns 1 if any configuration regressed, or is in the baseline but
+// not in the run although its backend is among backends.
+// A change counts only if it exceeds both the relative tolerance and NOISE_SIGMAS times
+// the combined noise of baseline and current run (MAD scaled to sigma).
+int compare_results(const std::vector<Result> &base, const std::vector<Result> &cur, double tolerance, const char *backends) {
+    int regressions = 0;
+    printf("%-7s %-7s %10s %4s %12s %12s %9s %9s %5s  %s\n",
+           "backend", "type", "size", "thr", "base_ms", "cur_ms", "delta", "thresh", "reps", "status");
+
+    for (const Result &c : cur) {
+        const Result *b = NULL;
+        for (const Result &r : base) {
+            if (r.backend == c.backend && r.type == c.type && r.size == c.size && r.threads == c.threads) {
+                b = &r;
+            }
+        }
+        if (b == NULL) {
+            printf("%-7s %-7s %10d %4d %12s %12.4f %9s %9s %5d  NEW\n",
+                   c.backend.c_str(), c.type.c_str(), c.size, c.threads, "-", c.median_ms, "-", "-", c.reps);
+            continue;
+        }
+
+        // Noise-aware threshold in ms, then as a fraction of the baseline
+        double noise = MAD_TO_SIGMA * sqrt(b->mad_ms * b->mad_ms + c.mad_ms * c.mad_ms);
+        double threshold = fmax(tolerance * b->median_ms, NOISE_SIGMAS * noise);
+        double delta = c.median_ms - b->median_ms;
+
+        const char *status = "ok";
+        if (delta > threshold) {
+            status = "REGRESSED";
+            regressions++;
+        } else if (-delta > threshold) {
+            status = "improved";
+        }
+        printf("%-7s %-7s %10d %4d %12.4f %12.4f %+8.1f%% %8.1f%% %5d  %s\n",
+               c.backend.c_str(), c.type.c_str(), c.size, c.threads, b->median_ms, c.median_ms,
+               100.0 * delta / b->median_ms, 100.0 * threshold / b->median_ms, c.reps, status);
+    }
+
+    // Baseline configurations the run did not produce: a backend that broke drops its rows
+    int missing = 0;
+    for (const Result &b : base) {
+        bool found = false;
+        for (const Result &c : cur) {
+            found = found || (c.backend == b.backend && c.type == b.type && c.size == b.size && c.threads == b.threads);
+        }
+        if (!found) {
+            bool selected = strstr(backends, b.backend.c_str()) != NULL;
+            printf("%-7s %-7s %10d %4d %12.4f %12s %9s %9s %5s  %s\n",
+                   b.backend.c_str(), b.type.c_str(), b.size, b.threads, b.median_ms, "-", "-", "-", "-",
+                   selected ? "MISSING" : "skipped");
+            missing += selected;
+        }
+    }
+
+    if (regressions > 0 || missing > 0) {
+        printf("%d configuration(s) regressed, %d missing\n", regressions, missing);
+        return 1;
+    }
+    printf("No regressions\n");
+    return 0;
+}
+
+// Allocate and initialize an array with random values between 0 and 99
+template <typename T>
+void init_t(T *&A, int size) {
+    A = (T *)malloc(sizeof(T) * size);
+    for (long i = 0; i < size; i++) {
+        A[i] = (T)(rand() % 100);
+    }
+}
+
+// Abort if v_out is not v1 + v2
+template <typename T>
+void check_t(const T *v1, const T *v2, const T *v_out, int size, const char *what) {
+    for (long i = 0; i < size; i++) {
+        if (v_out[i] != v1[i] + v2[i]) {
+            printf("%s produced a wrong result at element %ld\n", what, i);
+            exit(1);
+        }
+    }
+}
@@ -0,0 +1,382 @@
+// Client side of the vector add daemon protocol (vector_add_daemon.cpp).
+//
+// A client connects to the daemon's Unix socket and registers one shared memory region
+// (a memfd, passed over the socket with SCM_RIGHTS) that holds its vectors. Each add request
+// then names three element offsets in that region plus a size, a priority class and an
+// optional deadline; the daemon computes in place and answers with the time the request
+// waited and ran. One request is outstanding per connection; open more connections for more.
+// The memfd must be sealed against shrinking (F_SEAL_SHRINK) so the daemon's mapping stays
+// backed for as long as it uses it.
+//
+// The daemon applies admission control: VA_REJECTED means the request can never fit its
+// memory budget, VA_BUSY that it is overloaded right now and the client should retry after
+// reply.retry_after_us (va_add_retry does that).
+//
+// After va_ring_open() requests bypass the socket: client and daemon share a submission and a
+// completion ring (VaRing, another memfd, sealed like the region) in the style of io_uring.
+// Submitting is a store and an index update; the daemon's poller for the connection spins on the submission ring and
+// falls asleep on a futex only after it has been idle for a while, so a busy client makes no
+// system call per request. The client likewise spins briefly for its completion before
+// sleeping on the completion futex. va_add() and va_add_retry() use the ring when it is open;
+// va_ring_submit() / va_ring_reap() keep several requests in flight.
+#pragma once
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+
+#define VA_SOCKET_DEFAULT "/tmp/vector_add.sock"
+#define VA_MAGIC 0x56414444 // "VADD"
+#define VA_RING_ENTRIES 256  // Requests in flight per ring (power of two)
+#define VA_RING_SPIN_US 50   // Polling before sleeping on the futex
+
+// Priority classes, most urgent first
+enum VaPriority { VA_PRIO_INTERACTIVE, VA_PRIO_NORMAL, VA_PRIO_BATCH, VA_PRIO_CLASSES };
+static const char *VA_PRIO_NAMES[] = {"interactive", "normal", "batch"};
+
+enum VaOp { VA_OP_REGISTER, VA_OP_ADD, VA_OP_RING };
+enum VaStatus { VA_OK, VA_ERROR, VA_REJECTED, VA_BUSY };
+
+// Request; VA_OP_REGISTER and VA_OP_RING carry the memfd and its size in bytes in size
+struct VaRequest {
+    uint32_t magic;
+    uint32_t op;
+    uint32_t priority;
+    uint32_t reserved;
+    uint64_t id;
+    int64_t size;        // Elements to add (bytes of the region for VA_OP_REGISTER)
+    int64_t off_v1, off_v2, off_out; // Element offsets in the registered region
+    int64_t deadline_us; // Relative to receipt; 0 for none
+};
+
+// Reply to every request
+struct VaReply {
+    uint64_t id;
+    int32_t status;         // VaStatus
+    int32_t deadline_met;   // 1 if there was no deadline or it was met
+    int64_t queue_us;       // Receipt to first chunk
+    int64_t run_us;         // First chunk to completion
+    int64_t retry_after_us; // For VA_BUSY: when to try again
+};
+
+// Shared submission (client to daemon) and completion (daemon to client) rings. Each index
+// has one writer; the *_seq words are the futexes a side sleeps on once it has set *_sleeping.
+struct VaRing {
+    alignas(64) std::atomic<uint32_t> sq_tail; // Written by the client
+    alignas(64) std::atomic<uint32_t> sq_head; // Written by the daemon
+    std::atomic<uint32_t> sq_sleeping, sq_seq;
+    alignas(64) std::atomic<uint32_t> cq_tail; // Written by the daemon
+    alignas(64) std::atomic<uint32_t> cq_head; // Written by the client
+    std::atomic<uint32_t> cq_sleeping, cq_seq;
+    std::atomic<uint32_t> closed;              // Set by the client before it goes away
+    VaRequest sq[VA_RING_ENTRIES];
+    VaReply cq[VA_RING_ENTRIES];
+};
+
+// Client connection and its shared region
+struct VaClient {
+    int sock;
+    int memfd;
+    int *base;    // Region mapped in this process
+    size_t bytes;
+    uint64_t next_id;
+    VaRing *ring; // NULL until va_ring_open
+    int ring_fd;
+};
+
+// Wait on a futex shared between processes while *word == val (at most timeout_us if > 0)
+static inline void va_futex_wait(std::atomic<uint32_t> *word, uint32_t val, long timeout_us) {
+    struct timespec ts = {timeout_us / 1000000, (timeout_us % 1000000) * 1000};
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, val, timeout_us > 0 ? &ts : NULL, NULL, 0);
+}
+
+// Wake the other side if it went to sleep on seq (call after publishing a ring entry)
+static inline void va_futex_wake(std::atomic<uint32_t> *sleeping, std::atomic<uint32_t> *seq) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping->load(std::memory_order_relaxed)) {
+        seq->fetch_add(1);
+        syscall(SYS_futex, (uint32_t *)seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// Poll until ready() holds: spin for spin_us (-1: forever), then sleep on seq between checks
+// (sleeping announces it to the other side). On a single CPU spinning only delays the other
+// side, so it sleeps at once. Returns false if ready() still fails after timeout_us > 0.
+template <typename F>
+static inline bool va_ring_wait(F ready, std::atomic<uint32_t> *sleeping, std::atomic<uint32_t> *seq, long spin_us,
+                                long timeout_us) {
+    static const bool single_cpu = sysconf(_SC_NPROCESSORS_ONLN) <= 1;
+    spin_us = single_cpu ? 0 : spin_us;
+    auto start = std::chrono::steady_clock::now();
+    while (!ready()) {
+        long waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if (timeout_us > 0 && waited >= timeout_us) {
+            return false;
+        }
+        if (spin_us < 0 || waited < spin_us) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            continue;
+        }
+        uint32_t seen = seq->load();
+        sleeping->store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready()) {
+            va_futex_wait(seq, seen, timeout_us > 0 ? timeout_us - waited : 0);
+        }
+        sleeping->store(0);
+    }
+    return true;
+}
+
+// Send all of buf (with an fd attached if fd >= 0); false on failure
+static inline bool va_send(int sock, const void *buf, size_t len, int fd) {
+    struct iovec iov = {(void *)buf, len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+// Receive exactly len bytes (and an attached fd into *fd if given, else -1); false on EOF/error
+static inline bool va_recv(int sock, void *buf, size_t len, int *fd) {
+    struct iovec iov = {buf, len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t got = recvmsg(sock, &msg, MSG_WAITALL);
+    if (fd != NULL) {
+        *fd = -1;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (got > 0 && cmsg != NULL && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return got == (ssize_t)len;
+}
+
+// Connect to the daemon at path (NULL for the default); false if it is not running
+static inline bool va_connect(VaClient *c, const char *path) {
+    c->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    c->memfd = -1;
+    c->base = NULL;
+    c->bytes = 0;
+    c->next_id = 1;
+    c->ring = NULL;
+    c->ring_fd = -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path != NULL ? path : VA_SOCKET_DEFAULT);
+    if (c->sock < 0 || connect(c->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("Couldn't connect to the vector add daemon");
+        if (c->sock >= 0) {
+            close(c->sock);
+        }
+        return false;
+    }
+    return true;
+}
+
+// Create and register a shared region of elements ints; c->base points at it afterwards
+static inline bool va_register(VaClient *c, long elements) {
+    c->bytes = elements * sizeof(int);
+    c->memfd = memfd_create("vector_add", MFD_ALLOW_SEALING);
+    if (c->memfd < 0 || ftruncate(c->memfd, c->bytes) != 0 || fcntl(c->memfd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+        perror("Couldn't create the shared region");
+        return false;
+    }
+    c->base = (int *)mmap(NULL, c->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, c->memfd, 0);
+    if (c->base == MAP_FAILED) {
+        perror("Couldn't map the shared region");
+        c->base = NULL;
+        return false;
+    }
+    VaRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = VA_MAGIC;
+    req.op = VA_OP_REGISTER;
+    req.id = c->next_id++;
+    req.size = c->bytes;
+    VaReply reply;
+    if (!va_send(c->sock, &req, sizeof(req), c->memfd) || !va_recv(c->sock, &reply, sizeof(reply), NULL)) {
+        return false;
+    }
+    if (reply.status != VA_OK) {
+        fprintf(stderr, "Daemon refused a %zu-byte region (%s)\n", c->bytes,
+                reply.status == VA_REJECTED ? "over its memory budget" : reply.status == VA_BUSY ? "busy" : "error");
+    }
+    return reply.status == VA_OK;
+}
+
+// Switch the connection's requests to shared rings (after va_register); false if refused
+static inline bool va_ring_open(VaClient *c) {
+    c->ring_fd = memfd_create("vector_add_ring", MFD_ALLOW_SEALING);
+    if (c->ring_fd < 0 || ftruncate(c->ring_fd, sizeof(VaRing)) != 0 || fcntl(c->ring_fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+        perror("Couldn't create the request ring");
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(VaRing), PROT_READ | PROT_WRITE, MAP_SHARED, c->ring_fd, 0);
+    if (p == MAP_FAILED) {
+        perror("Couldn't map the request ring");
+        return false;
+    }
+    VaRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = VA_MAGIC;
+    req.op = VA_OP_RING;
+    req.id = c->next_id++;
+    req.size = sizeof(VaRing);
+    VaReply reply;
+    if (!va_send(c->sock, &req, sizeof(req), c->ring_fd) || !va_recv(c->sock, &reply, sizeof(reply), NULL) ||
+        reply.status != VA_OK) {
+        fprintf(stderr, "Daemon refused the request ring\n");
+        munmap(p, sizeof(VaRing));
+        return false;
+    }
+    c->ring = (VaRing *)p; // The memfd starts zeroed: empty rings, nobody asleep
+    return true;
+}
+
+// Queue an add on the ring; returns its id, or 0 if VA_RING_ENTRIES are already in flight
+// (reap some first)
+static inline uint64_t va_ring_submit(VaClient *c, long off_v1, long off_v2, long off_out, long size,
+                                      int priority, long deadline_us) {
+    VaRing *r = c->ring;
+    uint32_t tail = r->sq_tail.load(std::memory_order_relaxed);
+    if (tail - r->cq_head.load(std::memory_order_relaxed) >= VA_RING_ENTRIES) {
+        return 0; // Also keeps the completion ring from overflowing
+    }
+    VaRequest *req = &r->sq[tail % VA_RING_ENTRIES];
+    req->magic = VA_MAGIC;
+    req->op = VA_OP_ADD;
+    req->priority = priority;
+    req->id = c->next_id++;
+    req->size = size;
+    req->off_v1 = off_v1;
+    req->off_v2 = off_v2;
+    req->off_out = off_out;
+    req->deadline_us = deadline_us;
+    r->sq_tail.store(tail + 1, std::memory_order_release);
+    va_futex_wake(&r->sq_sleeping, &r->sq_seq);
+    return req->id;
+}
+
+// True if the peer closed sock (checked without blocking)
+static inline bool va_peer_closed(int sock) {
+    char byte;
+    return recv(sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+// Take the next completion into *reply, waiting for one if wait; false if there is none (or
+// the daemon went away while waiting)
+static inline bool va_ring_reap(VaClient *c, VaReply *reply, bool wait) {
+    VaRing *r = c->ring;
+    uint32_t head = r->cq_head.load(std::memory_order_relaxed);
+    auto ready = [&]() { return r->cq_tail.load(std::memory_order_acquire) != head; };
+    while (!ready()) {
+        if (!wait || va_peer_closed(c->sock)) {
+            return false;
+        }
+        va_ring_wait(ready, &r->cq_sleeping, &r->cq_seq, VA_RING_SPIN_US, 100000);
+    }
+    *reply = r->cq[head % VA_RING_ENTRIES];
+    r->cq_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// base[off_out..] = base[off_v1..] + base[off_v2..] for size elements; returns the VaStatus
+// (VA_ERROR if the daemon went away) and fills *reply. Through the ring when it is open (other
+// submissions must have been reaped).
+static inline int va_add(VaClient *c, long off_v1, long off_v2, long off_out, long size,
+                         int priority, long deadline_us, VaReply *reply) {
+    if (c->ring != NULL) {
+        if (va_ring_submit(c, off_v1, off_v2, off_out, size, priority, deadline_us) == 0 ||
+            !va_ring_reap(c, reply, true)) {
+            return VA_ERROR;
+        }
+        return reply->status;
+    }
+    VaRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = VA_MAGIC;
+    req.op = VA_OP_ADD;
+    req.priority = priority;
+    req.id = c->next_id++;
+    req.size = size;
+    req.off_v1 = off_v1;
+    req.off_v2 = off_v2;
+    req.off_out = off_out;
+    req.deadline_us = deadline_us;
+    if (!va_send(c->sock, &req, sizeof(req), -1) || !va_recv(c->sock, reply, sizeof(*reply), NULL)) {
+        return VA_ERROR;
+    }
+    return reply->status;
+}
+
+// va_add, resubmitting after the daemon's retry-after hint while it answers VA_BUSY (at most
+// max_tries attempts); *tries receives the number of attempts if not NULL
+static inline int va_add_retry(VaClient *c, long off_v1, long off_v2, long off_out, long size,
+                               int priority, long deadline_us, VaReply *reply, int max_tries, int *tries) {
+    int status = VA_BUSY;
+    int n = 0;
+    while (status == VA_BUSY && n < max_tries) {
+        if (n > 0) {
+            struct timespec ts = {reply->retry_after_us / 1000000, (reply->retry_after_us % 1000000) * 1000};
+            nanosleep(&ts, NULL);
+        }
+        status = va_add(c, off_v1, off_v2, off_out, size, priority, deadline_us, reply);
+        n++;
+    }
+    if (tries != NULL) {
+        *tries = n;
+    }
+    return status;
+}
+
+// Close the connection and unmap the region and the rings
+static inline void va_close(VaClient *c) {
+    if (c->ring != NULL) {
+        c->ring->closed.store(1);
+        c->ring->sq_sleeping.store(1); // Force the wakeup so the poller sees closed
+        va_futex_wake(&c->ring->sq_sleeping, &c->ring->sq_seq);
+        munmap(c->ring, sizeof(VaRing));
+    }
+    if (c->ring_fd >= 0) {
+        close(c->ring_fd);
+    }
+    if (c->base != NULL) {
+        munmap(c->base, c->bytes);
+    }
+    if (c->memfd >= 0) {
+        close(c->memfd);
+    }
+    close(c->sock);
+}
@@ -0,0 +1,392 @@
+// Vector add service: computes adds for local clients in their shared memory.
+//
+// Build: g++ -O3 -fopenmp vector_add_daemon.cpp -o vector_add_daemon -ldl
+// Usage: ./vector_add_daemon [--socket=/tmp/vector_add.sock] [--threads=0] [--chunk=65536]
+//                            [--host-fraction=0.8] [--max-backlog-ms=500] [--bandwidth=<GB/s>]
+//                            [--opencl] [--ocl-min=4194304] [--device-fraction=0.9] [--bw-cap]
+//                            [--ring-spin-us=50] [--socket-mode=0600]
+//
+// Clients (vector_add_client.h) connect over a Unix socket, register a memfd holding their
+// vectors and send add requests with a priority class (interactive, normal, batch) and an
+// optional deadline. Every request is served by the shared worker pool (vector_add_pool.h),
+// which splits it into --chunk element chunks and hands each free worker a chunk of the most
+// urgent request, earliest deadline first; a multi-GB batch add is therefore preempted at the
+// next chunk boundary when an interactive add arrives, and still gets a share of the chunks
+// while urgent work is queued. With --bw-cap the pool measures at startup how many workers
+// saturate each NUMA node's bandwidth and keeps at most that many busy, sharing them between
+// requests by class weight. On SIGINT/SIGTERM the daemon prints per-class latency and
+// deadline statistics and exits.
+//
+// Admission control (admission.h) keeps registered regions within --host-fraction of the
+// available host memory (cgroup limit included), device buffers within --device-fraction of
+// CL_DEVICE_GLOBAL_MEM_SIZE, and the queue within --max-backlog-ms of memory time at the
+// measured (or --bandwidth) bandwidth; beyond that clients get VA_BUSY with a retry-after
+// hint. With --opencl, adds of at least --ocl-min elements run on the OpenCL device, each with
+// its own queue and buffers. Device adds run synchronously on the connection's thread, outside
+// the pool's scheduler: their priority class and deadline are recorded but do not order them
+// against each other, and a batch device add is not preempted by an interactive one.
+//
+// The socket is created with --socket-mode (default 0600: only the daemon's user may connect;
+// e.g. 0660 admits its group). Clients compute on shared memory the daemon maps, so a region
+// must be sealed against shrinking and at least as large as claimed, and every request's
+// ranges must lie inside it; anything else is rejected.
+//
+// A client may switch its connection to shared submission/completion rings (va_ring_open).
+// The connection's thread then polls the submission ring instead of the socket, spinning for
+// --ring-spin-us after the last request (-1: always) before sleeping on the ring's futex, and
+// adds requests of up to one chunk itself rather than handing them to the pool, so a small
+// add costs no system call and no thread switch on either side. Two costs come with that:
+//   - inline adds skip the pool's priority/EDF pick and the --bw-cap node slot caps; they
+//     pass admission control but run as soon as they are polled, in any class
+//   - with --ring-spin-us=-1 every ring connection keeps one core busy for as long as it is
+//     open, even when idle; use it only with as many ring clients as spare cores
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "admission.h"
+#include "bench_stats.h"
+#include "vector_add_client.h"
+#include "vector_add_pool.h"
+
+int argc_g;
+char **argv_g;
+WorkerPool POOL;
+Admission ADMISSION;
+OclBackend OCL;       // Shared context and program when --opencl
+bool use_opencl = false;
+long ocl_min;         // Smallest add sent to the device
+long ring_spin_us;    // Ring polling before sleeping on the futex
+int listen_fd = -1;
+
+// Per-class service statistics
+std::mutex stats_mu;
+std::vector<double> latency_ms[VA_PRIO_CLASSES]; // Receipt to completion
+long deadlines[VA_PRIO_CLASSES], missed[VA_PRIO_CLASSES];
+
+const char *opt(const char *name, const char *def);
+bool has_flag(const char *name);
+bool memfd_usable(int fd, long bytes);
+void accept_clients();
+void serve_client(int fd);
+void serve_add(const VaRequest &req, int *base, size_t bytes, PoolTime received, bool inline_small, VaReply *reply);
+void serve_ring(VaRing *ring, int *base, size_t bytes, int fd);
+void print_stats();
+double measure_bandwidth();
+
+int main(int argc, char **argv) {
+    argc_g = argc;
+    argv_g = argv;
+    const char *path = opt("socket", VA_SOCKET_DEFAULT);
+    int threads = atoi(opt("threads", "0"));
+    long chunk = atol(opt("chunk", "65536"));
+
+    // Listen on the Unix socket, replacing a stale one; it is created owner-only and then
+    // opened up to --socket-mode, so nobody else can connect in between
+    mode_t socket_mode = (mode_t)strtol(opt("socket-mode", "0600"), NULL, 8);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    mode_t old_umask = umask(077);
+    bool bound = listen_fd >= 0 && bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(old_umask);
+    if (!bound || chmod(path, socket_mode) != 0 || listen(listen_fd, 64) != 0) {
+        perror("Couldn't listen on the socket");
+        exit(1);
+    }
+
+    // Block the stop signals in every thread; main waits for them below (a shell may have
+    // started us with SIGINT ignored, which would discard it before sigwait sees it)
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    CgroupLimits cgroup;
+    cgroup_detect(&cgroup);
+    cgroup_apply_omp(&cgroup); // Default pool size: the container's CPU limit
+    pool_start(&POOL, threads, chunk);
+    if (has_flag("bw-cap")) {
+        pool_calibrate(&POOL, 1 << 23, stdout);
+    }
+
+    // Budgets: host memory now, bandwidth measured on the pool unless given, device if enabled
+    double bandwidth = atof(opt("bandwidth", "0"));
+    if (bandwidth <= 0) {
+        bandwidth = measure_bandwidth();
+    }
+    admission_init(&ADMISSION, atof(opt("host-fraction", "0.8")), bandwidth, atof(opt("max-backlog-ms", "500")));
+    ocl_min = atol(opt("ocl-min", "4194304"));
+    ring_spin_us = atol(opt("ring-spin-us", "50"));
+    if (has_flag("opencl")) {
+        use_opencl = ocl_backend_init(&OCL, "./vector_ops_ocl.cl", "vector_add_ocl", NULL);
+        if (use_opencl) {
+            admission_set_device(&ADMISSION, OCL.device, atof(opt("device-fraction", "0.9")));
+        } else {
+            fprintf(stderr, "WARNING: OpenCL setup failed, serving every add on the CPU\n");
+        }
+    }
+
+    std::thread(accept_clients).detach();
+    printf("Listening on %s with %zu workers, %ld-element chunks\n", path, POOL.workers.size(), chunk);
+    printf("Budgets: host %.1f GB, device %.1f GB (max buffer %.1f GB), bandwidth %.2f GB/s, backlog %.0f ms\n",
+           ADMISSION.host_budget / 1e9, ADMISSION.device_budget / 1e9, ADMISSION.device_max_alloc / 1e9,
+           ADMISSION.bandwidth_gbs, ADMISSION.max_backlog_ms);
+    fflush(stdout);
+
+    int sig;
+    sigwait(&stop_signals, &sig);
+    close(listen_fd);
+    unlink(path);
+    print_stats();
+    pool_stop(&POOL); // Lets requests already in the pool finish
+    return 0;
+}
+
+// Bandwidth of one large add on the pool (GB/s), second run so pages are already faulted in
+double measure_bandwidth() {
+    long size = 1 << 23;
+    int *v1 = (int *)calloc(size, sizeof(int));
+    int *v2 = (int *)calloc(size, sizeof(int));
+    int *v_out = (int *)calloc(size, sizeof(int));
+    double ms = 0;
+    for (int run = 0; run < 2; run++) {
+        auto start = std::chrono::steady_clock::now();
+        pool_vector_add(&POOL, v1, v2, v_out, size);
+        auto stop = std::chrono::steady_clock::now();
+        ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    }
+    free(v1);
+    free(v2);
+    free(v_out);
+    return 3.0 * size * sizeof(int) / ms / 1e6;
+}
+
+// One thread per connection; it blocks in the pool while its request runs
+void accept_clients() {
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        std::thread(serve_client, fd).detach();
+    }
+}
+
+// True if a client's memfd can back a mapping of bytes: large enough, and sealed so the client
+// cannot shrink it later (pages past the end would fault with SIGBUS in the daemon)
+bool memfd_usable(int fd, long bytes) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < bytes) {
+        return false;
+    }
+    int seals = fcntl(fd, F_GET_SEALS);
+    return seals >= 0 && (seals & F_SEAL_SHRINK) != 0;
+}
+
+// Handle requests on one connection until the client closes it
+void serve_client(int fd) {
+    int *base = NULL;
+    size_t bytes = 0;
+    VaRequest req;
+    int passed_fd;
+    while (va_recv(fd, &req, sizeof(req), &passed_fd)) {
+        auto received = std::chrono::steady_clock::now();
+        VaReply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.id = req.id;
+        reply.status = VA_ERROR;
+        reply.deadline_met = 1;
+
+        if (req.magic != VA_MAGIC) {
+            break;
+        }
+        if (req.op == VA_OP_REGISTER) {
+            // Map the client's region, replacing an earlier one, if the host budget allows it
+            if (base != NULL) {
+                munmap(base, bytes);
+                admission_unregister(&ADMISSION, bytes);
+                base = NULL;
+            }
+            bool usable = passed_fd >= 0 && req.size > 0 && memfd_usable(passed_fd, req.size);
+            AdmitResult admit = usable ? admission_register(&ADMISSION, req.size) : ADMIT_REJECT;
+            if (admit == ADMIT_OK) {
+                void *p = mmap(NULL, req.size, PROT_READ | PROT_WRITE, MAP_SHARED, passed_fd, 0);
+                if (p != MAP_FAILED) {
+                    base = (int *)p;
+                    bytes = req.size;
+                    reply.status = VA_OK;
+                } else {
+                    admission_unregister(&ADMISSION, req.size);
+                }
+            } else {
+                reply.status = admit == ADMIT_BUSY ? VA_BUSY : VA_REJECTED;
+                reply.retry_after_us = 100000;
+            }
+            if (passed_fd >= 0) {
+                close(passed_fd);
+            }
+        } else if (req.op == VA_OP_ADD) {
+            serve_add(req, base, bytes, received, false, &reply);
+        } else if (req.op == VA_OP_RING) {
+            // Map the client's rings and poll them until it closes them
+            void *p = passed_fd >= 0 && base != NULL && req.size == sizeof(VaRing) && memfd_usable(passed_fd, sizeof(VaRing))
+                ? mmap(NULL, sizeof(VaRing), PROT_READ | PROT_WRITE, MAP_SHARED, passed_fd, 0) : MAP_FAILED;
+            if (passed_fd >= 0) {
+                close(passed_fd);
+            }
+            if (p != MAP_FAILED) {
+                reply.status = VA_OK;
+                if (!va_send(fd, &reply, sizeof(reply), -1)) {
+                    munmap(p, sizeof(VaRing));
+                    break;
+                }
+                serve_ring((VaRing *)p, base, bytes, fd);
+                munmap(p, sizeof(VaRing));
+                continue;
+            }
+        }
+        if (!va_send(fd, &reply, sizeof(reply), -1)) {
+            break;
+        }
+    }
+    if (base != NULL) {
+        munmap(base, bytes);
+        admission_unregister(&ADMISSION, bytes);
+    }
+    close(fd);
+}
+
+// Validate, admit and run one add on the client's region, filling *reply; with inline_small
+// adds of at most one chunk run on the calling thread
+void serve_add(const VaRequest &req, int *base, size_t bytes, PoolTime received, bool inline_small, VaReply *reply) {
+    // Every range must lie inside the registered region
+    long elements = bytes / sizeof(int);
+    bool valid = base != NULL && req.size >= 0 && req.priority < VA_PRIO_CLASSES;
+    for (int64_t off : {req.off_v1, req.off_v2, req.off_out}) {
+        valid = valid && off >= 0 && off <= elements && req.size <= elements - off;
+    }
+    bool on_device = use_opencl && req.size >= ocl_min;
+    long retry_after_us = 0;
+    AdmitResult admit = valid ? admission_acquire(&ADMISSION, req.size, on_device, &retry_after_us) : ADMIT_REJECT;
+    if (valid && admit != ADMIT_OK) {
+        reply->status = admit == ADMIT_BUSY ? VA_BUSY : VA_REJECTED;
+        reply->retry_after_us = retry_after_us;
+    }
+    if (valid && admit == ADMIT_OK) {
+        PoolTime deadline = req.deadline_us > 0 ? received + std::chrono::microseconds(req.deadline_us)
+                                                : PoolTime::max();
+        PoolTime started = std::chrono::steady_clock::now();
+        bool ok = true;
+        if (on_device) {
+            ok = pool_vector_add_ocl(&OCL, base + req.off_v1, base + req.off_v2, base + req.off_out, req.size);
+        } else if (inline_small && req.size <= POOL.chunk) {
+            int *v1 = base + req.off_v1, *v2 = base + req.off_v2, *v_out = base + req.off_out;
+            for (long i = 0; i < req.size; i++) {
+                v_out[i] = v1[i] + v2[i];
+            }
+        } else {
+            pool_vector_add_sched(&POOL, base + req.off_v1, base + req.off_v2, base + req.off_out, req.size,
+                                  req.priority, deadline, &started);
+        }
+        admission_release(&ADMISSION, req.size, on_device);
+        auto done = std::chrono::steady_clock::now();
+        reply->status = ok ? VA_OK : VA_ERROR;
+        reply->deadline_met = done <= deadline;
+        reply->queue_us = std::chrono::duration_cast<std::chrono::microseconds>(started - received).count();
+        reply->run_us = std::chrono::duration_cast<std::chrono::microseconds>(done - started).count();
+
+        std::lock_guard<std::mutex> lock(stats_mu);
+        latency_ms[req.priority].push_back(std::chrono::duration<double, std::milli>(done - received).count());
+        if (req.deadline_us > 0) {
+            deadlines[req.priority]++;
+            missed[req.priority] += !reply->deadline_met;
+        }
+    }
+}
+
+// Serve a connection's rings until the client closes them or goes away
+void serve_ring(VaRing *ring, int *base, size_t bytes, int fd) {
+    uint32_t head = ring->sq_head.load();
+    auto ready = [&]() { return ring->sq_tail.load(std::memory_order_acquire) != head || ring->closed.load(); };
+    while (true) {
+        if (!va_ring_wait(ready, &ring->sq_sleeping, &ring->sq_seq, ring_spin_us, 100000)) {
+            if (va_peer_closed(fd)) {
+                return; // Exited without closing the ring
+            }
+            continue;
+        }
+        if (ring->closed.load()) {
+            return;
+        }
+        VaRequest req = ring->sq[head % VA_RING_ENTRIES];
+        ring->sq_head.store(++head, std::memory_order_release);
+
+        VaReply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.id = req.id;
+        reply.status = VA_ERROR;
+        reply.deadline_met = 1;
+        if (req.magic == VA_MAGIC && req.op == VA_OP_ADD) {
+            serve_add(req, base, bytes, std::chrono::steady_clock::now(), true, &reply);
+        }
+
+        // The client never has more in flight than the ring holds, so the slot is free
+        uint32_t tail = ring->cq_tail.load(std::memory_order_relaxed);
+        ring->cq[tail % VA_RING_ENTRIES] = reply;
+        ring->cq_tail.store(tail + 1, std::memory_order_release);
+        va_futex_wake(&ring->cq_sleeping, &ring->cq_seq);
+    }
+}
+
+// Latency percentiles and deadline misses per priority class
+void print_stats() {
+    std::lock_guard<std::mutex> lock(stats_mu);
+    printf("%-12s %8s %10s %10s %10s %10s\n", "class", "requests", "p50_ms", "p99_ms", "deadlines", "missed");
+    for (int c = 0; c < VA_PRIO_CLASSES; c++) {
+        printf("%-12s %8zu %10.3f %10.3f %10ld %10ld\n", VA_PRIO_NAMES[c], latency_ms[c].size(),
+               percentile(latency_ms[c], 50), percentile(latency_ms[c], 99), deadlines[c], missed[c]);
+    }
+    std::lock_guard<std::mutex> admission_lock(ADMISSION.mu);
+    printf("admission: %ld rejected, %ld told to retry, %ld queued for device memory\n",
+           ADMISSION.rejected, ADMISSION.busy, ADMISSION.queued);
+}
+
+// Value of --name=value, or def if absent
+const char *opt(const char *name, const char *def) {
+    size_t len = strlen(name);
+    for (int i = 1; i < argc_g; i++) {
+        if (strncmp(argv_g[i], "--", 2) == 0 && strncmp(argv_g[i] + 2, name, len) == 0 && argv_g[i][2 + len] == '=') {
+            return argv_g[i] + 3 + len;
+        }
+    }
+    return def;
+}
+
+// True if --name was given
+bool has_flag(const char *name) {
+    for (int i = 1; i < argc_g; i++) {
+        if (strncmp(argv_g[i], "--", 2) == 0 && strcmp(argv_g[i] + 2, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,324 @@
+// Vector add engine: runs long or repeated adds chunk by chunk and keeps choosing the
+// currently fastest implementation variant with an epsilon-greedy explore/exploit policy.
+//
+// Every chunk is timed. With probability epsilon a chunk is handed to a random other variant
+// (exploration), otherwise to the variant with the best recent throughput (exploitation).
+// Throughput is an exponentially weighted moving average, so a variant that was fast before
+// the machine got busy loses its lead within a few chunks. Switches are logged.
+//
+// The OpenCL variant is set up the first time it is picked, so runs that never get that far
+// do not pay for loading the runtime. If setup fails the variant is disabled and the engine
+// carries on with the OpenMP variants.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <omp.h> // For OpenMP multi-threading
+#ifdef __SSE2__
+#include <emmintrin.h> // Non-temporal stores
+#endif
+#include "bench_stats.h"
+#include "ocl_common.h"
+
+#define ENGINE_CHUNK (1 << 20)    // Elements per scheduling chunk
+#define ENGINE_EPSILON 0.05       // Probability of exploring on a chunk
+#define ENGINE_EWMA_ALPHA 0.2     // Weight of the newest sample in the moving average
+#define ENGINE_SWITCH_MARGIN 0.03 // A challenger must be this much faster to take over
+
+// Kinds of implementation the engine can choose between
+enum VariantKind {
+    VARIANT_OMP,    // OpenMP loop with a given team size
+    VARIANT_OMP_NT, // OpenMP loop with non-temporal (cache-bypassing) stores
+    VARIANT_OCL     // OpenCL kernel including chunk transfers
+};
+
+// One candidate implementation and its observed speed
+struct Variant {
+    char name[32];
+    VariantKind kind;
+    int threads;         // OpenMP team size (unused for OpenCL)
+    double ns_per_elem;  // Moving average of time per element, 0 until first sample
+    long samples;        // Chunks timed with this variant
+    bool disabled;       // Could not be set up; never picked again
+};
+
+// Engine state; one engine may serve many calls so its measurements carry over
+struct Engine {
+    std::vector<Variant> variants;
+    int current;         // Index of the variant being exploited
+    long chunk;          // Elements per chunk
+    double epsilon;
+    uint64_t rng;
+    long switches;       // Number of times the exploited variant changed
+    FILE *log;           // Where switches are reported (NULL for silent)
+
+    // OpenCL variant state (only when enabled; set up on first pick)
+    bool ocl_enabled;
+    bool ocl_ready;
+    OclBackend ocl;
+    cl_mem bufV1, bufV2, bufV_out; // Chunk-sized device buffers
+};
+
+// Multi-threaded add of [begin, end) with a given team size
+static inline void engine_add_omp(const int *v1, const int *v2, int *v_out, long begin, long end, int threads) {
+    #pragma omp parallel for num_threads(threads)
+    for (long i = begin; i < end; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+}
+
+// Multi-threaded add of [begin, end) writing the output with non-temporal stores
+static inline void engine_add_omp_nt(const int *v1, const int *v2, int *v_out, long begin, long end, int threads) {
+#ifdef __SSE2__
+    #pragma omp parallel num_threads(threads)
+    {
+        // Static split of the range; each thread aligns its own output to 16 bytes
+        int t = omp_get_thread_num();
+        int n = omp_get_num_threads();
+        long len = end - begin;
+        long lo = begin + len * t / n;
+        long hi = begin + len * (t + 1) / n;
+        long i = lo;
+        while (i < hi && ((uintptr_t)(v_out + i) & 15) != 0) {
+            v_out[i] = v1[i] + v2[i];
+            i++;
+        }
+        for (; i + 4 <= hi; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(v1 + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(v2 + i));
+            _mm_stream_si128((__m128i *)(v_out + i), _mm_add_epi32(a, b));
+        }
+        for (; i < hi; i++) {
+            v_out[i] = v1[i] + v2[i];
+        }
+        _mm_sfence(); // Make the streamed stores visible before the region ends
+    }
+#else
+    engine_add_omp(v1, v2, v_out, begin, end, threads);
+#endif
+}
+
+// Add [begin, end) on the OpenCL device: write inputs, run kernel, read result
+static inline void engine_add_ocl(Engine *e, const int *v1, const int *v2, int *v_out, long begin, long end) {
+    int len = (int)(end - begin);
+    size_t bytes = len * sizeof(int);
+    size_t global[1] = {(size_t)len};
+    clEnqueueWriteBuffer(e->ocl.queue, e->bufV1, CL_FALSE, 0, bytes, v1 + begin, 0, NULL, NULL);
+    clEnqueueWriteBuffer(e->ocl.queue, e->bufV2, CL_FALSE, 0, bytes, v2 + begin, 0, NULL, NULL);
+    clSetKernelArg(e->ocl.kernel, 0, sizeof(int), &len);
+    clSetKernelArg(e->ocl.kernel, 1, sizeof(cl_mem), &e->bufV1);
+    clSetKernelArg(e->ocl.kernel, 2, sizeof(cl_mem), &e->bufV2);
+    clSetKernelArg(e->ocl.kernel, 3, sizeof(cl_mem), &e->bufV_out);
+    clEnqueueNDRangeKernel(e->ocl.queue, e->ocl.kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+    clEnqueueReadBuffer(e->ocl.queue, e->bufV_out, CL_TRUE, 0, bytes, v_out + begin, 0, NULL, NULL);
+}
+
+// Add a candidate variant
+static inline void engine_add_variant(Engine *e, const char *name, VariantKind kind, int threads) {
+    Variant v;
+    snprintf(v.name, sizeof(v.name), "%s", name);
+    v.kind = kind;
+    v.threads = threads;
+    v.ns_per_elem = 0;
+    v.samples = 0;
+    v.disabled = false;
+    e->variants.push_back(v);
+}
+
+// Set up the candidate variants: OpenMP at 1, 2, 4, ... and max threads, NT stores, OpenCL
+static inline void engine_init(Engine *e, bool use_opencl, FILE *log) {
+    char name[32];
+    int max_threads = omp_get_max_threads();
+    e->variants.clear();
+    for (int t = 1; t < max_threads; t *= 2) {
+        snprintf(name, sizeof(name), "omp-%d", t);
+        engine_add_variant(e, name, VARIANT_OMP, t);
+    }
+    snprintf(name, sizeof(name), "omp-%d", max_threads);
+    int omp_max = (int)e->variants.size();
+    engine_add_variant(e, name, VARIANT_OMP, max_threads);
+#ifdef __SSE2__
+    snprintf(name, sizeof(name), "omp-nt-%d", max_threads);
+    engine_add_variant(e, name, VARIANT_OMP_NT, max_threads);
+#endif
+
+    e->ocl_enabled = use_opencl;
+    e->ocl_ready = false;
+    if (use_opencl) {
+        engine_add_variant(e, "opencl", VARIANT_OCL, 0);
+    }
+
+    // Start on the full OpenMP team so a small first call does not load OpenCL
+    e->current = omp_max;
+    e->chunk = ENGINE_CHUNK;
+    e->epsilon = ENGINE_EPSILON;
+    e->rng = 0x853c49e6748fea9bULL;
+    e->switches = 0;
+    e->log = log;
+}
+
+// Set up the OpenCL backend and chunk buffers; false if OpenCL is unusable here
+static inline bool engine_ocl_setup(Engine *e) {
+    if (!ocl_backend_init(&e->ocl, "./vector_ops_ocl.cl", "vector_add_ocl", NULL)) {
+        return false;
+    }
+    cl_int err1, err2, err3;
+    e->bufV1 = clCreateBuffer(e->ocl.context, CL_MEM_READ_ONLY, ENGINE_CHUNK * sizeof(int), NULL, &err1);
+    e->bufV2 = clCreateBuffer(e->ocl.context, CL_MEM_READ_ONLY, ENGINE_CHUNK * sizeof(int), NULL, &err2);
+    e->bufV_out = clCreateBuffer(e->ocl.context, CL_MEM_WRITE_ONLY, ENGINE_CHUNK * sizeof(int), NULL, &err3);
+    if (err1 < 0 || err2 < 0 || err3 < 0) {
+        fprintf(stderr, "Couldn't create engine buffers\n");
+        if (err1 >= 0) clReleaseMemObject(e->bufV1);
+        if (err2 >= 0) clReleaseMemObject(e->bufV2);
+        if (err3 >= 0) clReleaseMemObject(e->bufV_out);
+        ocl_backend_release(&e->ocl);
+        return false;
+    }
+    return true;
+}
+
+// Make sure variant i can run, setting up OpenCL on its first pick. A variant that cannot be
+// set up is disabled and, if it was current, replaced by the last usable variant.
+static inline bool engine_ready(Engine *e, int i) {
+    Variant &v = e->variants[i];
+    if (v.kind != VARIANT_OCL || e->ocl_ready) {
+        return !v.disabled;
+    }
+    if (!v.disabled) {
+        auto start = std::chrono::high_resolution_clock::now();
+        e->ocl_ready = engine_ocl_setup(e);
+        auto stop = std::chrono::high_resolution_clock::now();
+        if (e->ocl_ready) {
+            if (e->log != NULL) {
+                fprintf(e->log, "[engine] OpenCL ready after %.1f ms\n",
+                        std::chrono::duration<double, std::milli>(stop - start).count());
+            }
+            return true;
+        }
+        v.disabled = true;
+        if (e->log != NULL) {
+            fprintf(e->log, "[engine] OpenCL unavailable, falling back to OpenMP\n");
+        }
+    }
+    if (e->current == i) {
+        for (int j = (int)e->variants.size() - 1; j >= 0; j--) {
+            if (!e->variants[j].disabled) {
+                e->current = j;
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+// Run one chunk on a variant
+static inline void engine_run_variant(Engine *e, const Variant &v, const int *v1, const int *v2, int *v_out, long begin, long end) {
+    switch (v.kind) {
+    case VARIANT_OMP:
+        engine_add_omp(v1, v2, v_out, begin, end, v.threads);
+        break;
+    case VARIANT_OMP_NT:
+        engine_add_omp_nt(v1, v2, v_out, begin, end, v.threads);
+        break;
+    case VARIANT_OCL:
+        engine_add_ocl(e, v1, v2, v_out, begin, end);
+        break;
+    }
+}
+
+// Index of the variant with the lowest moving-average time per element
+// (keeps the current variant until some variant has been measured)
+static inline int engine_best(const Engine *e) {
+    int best = -1;
+    for (int i = 0; i < (int)e->variants.size(); i++) {
+        if (e->variants[i].samples > 0 && !e->variants[i].disabled && (best < 0 || e->variants[i].ns_per_elem < e->variants[best].ns_per_elem)) {
+            best = i;
+        }
+    }
+    return best < 0 ? e->current : best;
+}
+
+// Pick the variant for the next chunk: untried variants first, then epsilon-greedy
+static inline int engine_choose(Engine *e) {
+    for (int i = 0; i < (int)e->variants.size(); i++) {
+        if (e->variants[i].samples == 0 && !e->variants[i].disabled) {
+            return i;
+        }
+    }
+    if ((stats_rand(&e->rng) % 1000000) < e->epsilon * 1000000 && e->variants.size() > 1) {
+        int other = (int)(stats_rand(&e->rng) % (e->variants.size() - 1));
+        other = other >= e->current ? other + 1 : other;
+        return e->variants[other].disabled ? e->current : other;
+    }
+    return e->current;
+}
+
+// v_out = v1 + v2, chunk by chunk, adapting the variant as measurements come in.
+// Calls shorter than one chunk just use the current variant.
+static inline void engine_vector_add(Engine *e, const int *v1, const int *v2, int *v_out, long size) {
+    if (size < e->chunk) {
+        engine_ready(e, e->current);
+        engine_run_variant(e, e->variants[e->current], v1, v2, v_out, 0, size);
+        return;
+    }
+
+    for (long begin = 0; begin < size; begin += e->chunk) {
+        long end = begin + e->chunk < size ? begin + e->chunk : size;
+        int pick = engine_choose(e);
+        if (!engine_ready(e, pick)) {
+            pick = e->current; // The chunk still runs, on an OpenMP variant
+        }
+        Variant &v = e->variants[pick];
+
+        auto start = std::chrono::high_resolution_clock::now();
+        engine_run_variant(e, v, v1, v2, v_out, begin, end);
+        auto stop = std::chrono::high_resolution_clock::now();
+
+        // Only full chunks are comparable samples; the ragged tail is not recorded
+        if (end - begin == e->chunk) {
+            double ns = std::chrono::duration<double, std::nano>(stop - start).count() / (end - begin);
+            v.ns_per_elem = v.samples == 0 ? ns : (1 - ENGINE_EWMA_ALPHA) * v.ns_per_elem + ENGINE_EWMA_ALPHA * ns;
+            v.samples++;
+        }
+
+        // Exploit whichever variant is clearly fastest now; log when that changes
+        int best = engine_best(e);
+        const Variant &cur = e->variants[e->current];
+        bool clearly_faster = cur.samples == 0 ||
+            e->variants[best].ns_per_elem < (1 - ENGINE_SWITCH_MARGIN) * cur.ns_per_elem;
+        if (best != e->current && clearly_faster) {
+            if (e->log != NULL && cur.samples > 0) {
+                fprintf(e->log, "[engine] switch %s -> %s (%.2f -> %.2f GB/s)\n",
+                        e->variants[e->current].name, e->variants[best].name,
+                        3 * sizeof(int) / e->variants[e->current].ns_per_elem,
+                        3 * sizeof(int) / e->variants[best].ns_per_elem);
+            }
+            e->current = best;
+            e->switches++;
+        }
+    }
+}
+
+// Print the current estimate for every variant
+static inline void engine_print_stats(const Engine *e, FILE *out) {
+    fprintf(out, "%-12s %8s %10s\n", "variant", "chunks", "GB/s");
+    for (int i = 0; i < (int)e->variants.size(); i++) {
+        const Variant &v = e->variants[i];
+        fprintf(out, "%-12s %8ld %10.2f%s\n", v.name, v.samples,
+                v.samples > 0 ? 3 * sizeof(int) / v.ns_per_elem : 0.0,
+                v.disabled ? "  (unavailable)" : i == e->current ? "  <- current" : "");
+    }
+}
+
+// Release OpenCL objects if the OpenCL variant was set up
+static inline void engine_release(Engine *e) {
+    if (e->ocl_ready) {
+        clReleaseMemObject(e->bufV1);
+        clReleaseMemObject(e->bufV2);
+        clReleaseMemObject(e->bufV_out);
+        ocl_backend_release(&e->ocl);
+    }
+}
@@ -0,0 +1,341 @@
+// Open-loop load generator for the vector add daemon (vector_add_daemon.cpp).
+//
+// Build: g++ -O2 vector_add_loadgen.cpp -o vector_add_loadgen -pthread
+// Usage: ./vector_add_loadgen [--socket=/tmp/vector_add.sock] [--rate=1000] [--duration=10]
+//                             [--arrivals=poisson|uniform] [--trace=<file>]
+//                             [--sizes=65536] [--priority=normal] [--deadline-us=0]
+//                             [--connections=8] [--max-tries=10] [--seed=1] [--histogram] [--ring]
+//
+// Requests arrive on a schedule fixed before the run, independent of how fast the daemon
+// answers (open loop): --rate per second for --duration seconds, with exponential
+// (poisson) or constant (uniform) gaps, or at the times listed in --trace, one request per
+// line as "<time_us> <elements> [interactive|normal|batch]". --sizes draws each request's
+// element count from a weighted list, e.g. "65536:0.9,16777216:0.1".
+//
+// Each request is sent by the next free one of --connections connections, each with its own
+// registered region. Latency is measured from the request's scheduled time, not from when a
+// connection got around to sending it: when the daemon falls behind, the time a request spent
+// waiting for a connection is counted instead of silently thinned out (coordinated omission).
+// The service time (send to reply) is reported next to it. VA_BUSY replies are retried after
+// the daemon's hint, up to --max-tries attempts, and the wait counts as latency; VA_REJECTED
+// requests are counted and left out of the latencies. With --ring every connection sends
+// through the shared-memory rings (va_ring_open) instead of the socket.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_env.h"
+#include "bench_stats.h"
+#include "vector_add_client.h"
+
+// One scheduled request and its outcome
+struct Arrival {
+    long at_us;      // Scheduled time from the start of the run
+    long size;       // Elements
+    int priority;
+    int status;      // VaStatus of the last attempt
+    int tries;
+    long latency_us; // Scheduled time to reply
+    long service_us; // Last send to reply
+};
+
+int argc_g;
+char **argv_g;
+std::vector<Arrival> arrivals;
+std::atomic<size_t> next_arrival(0);
+std::chrono::steady_clock::time_point run_start;
+const char *socket_path;
+long deadline_us;
+int max_tries;
+
+const char *opt(const char *name, const char *def);
+bool has_flag(const char *name);
+int priority_parse(const char *name);
+bool read_trace(const char *path);
+bool parse_sizes(const char *sizes, std::vector<long> &values, std::vector<double> &weights);
+void generate_arrivals(double rate, double duration, bool poisson, const std::vector<long> &size_values,
+                       const std::vector<double> &size_weights, int priority, uint64_t seed);
+bool open_connection(VaClient *c, long max_size);
+void send_requests(VaClient *c, long max_size);
+
+int main(int argc, char **argv) {
+    argc_g = argc;
+    argv_g = argv;
+    socket_path = opt("socket", VA_SOCKET_DEFAULT);
+    deadline_us = atol(opt("deadline-us", "0"));
+    max_tries = atoi(opt("max-tries", "10"));
+    int connections = atoi(opt("connections", "8"));
+    int priority = priority_parse(opt("priority", "normal"));
+    if (priority < 0) {
+        fprintf(stderr, "Unknown priority class: %s\n", opt("priority", ""));
+        return 1;
+    }
+    if (connections < 1) {
+        fprintf(stderr, "--connections must be at least 1\n");
+        return 1;
+    }
+
+    // Build the whole schedule before sending anything
+    const char *trace = opt("trace", NULL);
+    if (trace != NULL) {
+        if (!read_trace(trace)) {
+            return 1;
+        }
+    } else {
+        const char *kind = opt("arrivals", "poisson");
+        if (strcmp(kind, "poisson") != 0 && strcmp(kind, "uniform") != 0) {
+            fprintf(stderr, "Unknown arrival process: %s\n", kind);
+            return 1;
+        }
+        double rate = atof(opt("rate", "1000"));
+        double duration = atof(opt("duration", "10"));
+        if (rate <= 0 || duration <= 0) {
+            fprintf(stderr, "--rate and --duration must be greater than 0\n");
+            return 1;
+        }
+        std::vector<long> size_values;
+        std::vector<double> size_weights;
+        if (!parse_sizes(opt("sizes", "65536"), size_values, size_weights)) {
+            fprintf(stderr, "--sizes needs entries n[:weight] with n > 0, weight >= 0 and some weight > 0\n");
+            return 1;
+        }
+        generate_arrivals(rate, duration, strcmp(kind, "poisson") == 0, size_values, size_weights, priority,
+                          strtoull(opt("seed", "1"), NULL, 10));
+    }
+    if (arrivals.empty()) {
+        fprintf(stderr, "No requests to send\n");
+        return 1;
+    }
+    long max_size = 0;
+    for (const Arrival &a : arrivals) {
+        max_size = a.size > max_size ? a.size : max_size;
+    }
+
+    BenchEnv env;
+    env_capture(&env);
+    env_print(&env, stdout);
+    env_warn(&env);
+    printf("Sending %zu requests over %.2f s on %d connections\n", arrivals.size(), arrivals.back().at_us / 1e6,
+           connections);
+    fflush(stdout);
+
+    // Connect and fill every region before the clock starts
+    std::vector<VaClient> clients(connections);
+    for (int c = 0; c < connections; c++) {
+        if (!open_connection(&clients[c], max_size)) {
+            return 1;
+        }
+    }
+
+    // Connections take the next scheduled request whenever they are free
+    std::vector<std::thread> senders;
+    run_start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    for (int c = 0; c < connections; c++) {
+        senders.emplace_back(send_requests, &clients[c], max_size);
+    }
+    for (std::thread &t : senders) {
+        t.join();
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    for (VaClient &c : clients) {
+        va_close(&c);
+    }
+
+    // Latency per class and overall; the last row is every completed request
+    LatencyHistogram latency[VA_PRIO_CLASSES + 1], service[VA_PRIO_CLASSES + 1];
+    long rejected = 0, gave_up = 0, errors = 0, retries = 0, missed = 0;
+    for (int c = 0; c <= VA_PRIO_CLASSES; c++) {
+        hist_init(&latency[c]);
+        hist_init(&service[c]);
+    }
+    for (const Arrival &a : arrivals) {
+        retries += a.tries > 1 ? a.tries - 1 : 0;
+        if (a.status == VA_OK) {
+            for (int c : {a.priority, (int)VA_PRIO_CLASSES}) {
+                hist_record(&latency[c], a.latency_us);
+                hist_record(&service[c], a.service_us);
+            }
+            missed += deadline_us > 0 && a.latency_us > deadline_us;
+        } else if (a.status == VA_REJECTED) {
+            rejected++;
+        } else if (a.status == VA_BUSY) {
+            gave_up++;
+        } else {
+            errors++;
+        }
+    }
+
+    printf("offered %.1f req/s, completed %.1f req/s; %ld retries, %ld gave up busy, %ld rejected, %ld errors\n",
+           arrivals.size() / (arrivals.back().at_us / 1e6 + 1e-9), latency[VA_PRIO_CLASSES].total / wall_s, retries,
+           gave_up, rejected, errors);
+    if (deadline_us > 0) {
+        printf("deadline %ld us missed by %ld requests (from scheduled time)\n", deadline_us, missed);
+    }
+    printf("%-12s %8s %10s %10s %10s %10s %10s %10s\n", "class", "requests", "p50_us", "p90_us", "p99_us",
+           "p99.9_us", "max_us", "svc_p99");
+    for (int c = 0; c <= VA_PRIO_CLASSES; c++) {
+        if (latency[c].total == 0 && c < VA_PRIO_CLASSES) {
+            continue;
+        }
+        printf("%-12s %8ld %10ld %10ld %10ld %10ld %10ld %10ld\n", c < VA_PRIO_CLASSES ? VA_PRIO_NAMES[c] : "all",
+               latency[c].total, hist_percentile(&latency[c], 50), hist_percentile(&latency[c], 90),
+               hist_percentile(&latency[c], 99), hist_percentile(&latency[c], 99.9), latency[c].max_us,
+               hist_percentile(&service[c], 99));
+    }
+    if (has_flag("histogram")) {
+        printf("Latency histogram (all classes, from scheduled time):\n");
+        hist_print(&latency[VA_PRIO_CLASSES], stdout);
+    }
+    return errors > 0 ? 1 : 0;
+}
+
+// Connect and register a region with room for the largest request's three vectors (and open
+// the rings with --ring)
+bool open_connection(VaClient *c, long max_size) {
+    if (!va_connect(c, socket_path)) {
+        return false;
+    }
+    if (!va_register(c, 3 * max_size)) {
+        va_close(c);
+        return false;
+    }
+    if (has_flag("ring") && !va_ring_open(c)) {
+        va_close(c);
+        return false;
+    }
+    for (long i = 0; i < 3 * max_size; i++) {
+        c->base[i] = (int)i;
+    }
+    return true;
+}
+
+// Connection loop: send the next scheduled request whenever this connection is free
+void send_requests(VaClient *c, long max_size) {
+    size_t i;
+    while ((i = next_arrival++) < arrivals.size()) {
+        Arrival &a = arrivals[i];
+        auto scheduled = run_start + std::chrono::microseconds(a.at_us);
+        std::this_thread::sleep_until(scheduled); // Returns at once if we are already late
+        VaReply reply;
+        auto sent = std::chrono::steady_clock::now();
+        a.status = va_add_retry(c, 0, max_size, 2 * max_size, a.size, a.priority, deadline_us, &reply, max_tries,
+                                &a.tries);
+        auto done = std::chrono::steady_clock::now();
+        a.latency_us = std::chrono::duration_cast<std::chrono::microseconds>(done - scheduled).count();
+        a.service_us = std::chrono::duration_cast<std::chrono::microseconds>(done - sent).count();
+        if (a.status == VA_ERROR) {
+            break; // The daemon went away; the rest of this connection's share stays unsent
+        }
+    }
+}
+
+// Request sizes and weights from "n:weight,..." (weight defaults to 1); false unless every
+// size is positive, no weight is negative and at least one is positive
+bool parse_sizes(const char *sizes, std::vector<long> &values, std::vector<double> &weights) {
+    std::string spec = sizes;
+    size_t pos = 0;
+    double total = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        end = end == std::string::npos ? spec.size() : end;
+        std::string item = spec.substr(pos, end - pos);
+        size_t colon = item.find(':');
+        values.push_back(atol(item.c_str()));
+        weights.push_back(colon == std::string::npos ? 1.0 : atof(item.c_str() + colon + 1));
+        if (values.back() <= 0 || weights.back() < 0) {
+            return false;
+        }
+        total += weights.back();
+        pos = end + 1;
+    }
+    return total > 0;
+}
+
+// Schedule rate requests per second for duration seconds, sizes drawn by weight
+void generate_arrivals(double rate, double duration, bool poisson, const std::vector<long> &size_values,
+                       const std::vector<double> &size_weights, int priority, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> gap(rate);
+    std::discrete_distribution<int> pick(size_weights.begin(), size_weights.end());
+    double t = 0;
+    while (true) {
+        t += poisson ? gap(rng) : 1.0 / rate;
+        if (t >= duration) {
+            break;
+        }
+        Arrival a;
+        memset(&a, 0, sizeof(a));
+        a.at_us = (long)(t * 1e6);
+        a.size = size_values[pick(rng)];
+        a.priority = priority;
+        a.status = VA_ERROR; // Until a connection sends it
+        arrivals.push_back(a);
+    }
+}
+
+// Schedule from a trace file of "<time_us> <elements> [class]" lines (sorted by time)
+bool read_trace(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror("Couldn't open the trace");
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        Arrival a;
+        memset(&a, 0, sizeof(a));
+        char cls[32] = "normal";
+        if (line[0] == '#' || sscanf(line, "%ld %ld %31s", &a.at_us, &a.size, cls) < 2) {
+            continue;
+        }
+        a.priority = priority_parse(cls);
+        if (a.priority < 0 || a.size <= 0) {
+            fprintf(stderr, "Bad trace line: %s", line);
+            fclose(f);
+            return false;
+        }
+        a.status = VA_ERROR;
+        arrivals.push_back(a);
+    }
+    fclose(f);
+    std::stable_sort(arrivals.begin(), arrivals.end(),
+                     [](const Arrival &x, const Arrival &y) { return x.at_us < y.at_us; });
+    return true;
+}
+
+// Priority class by name, -1 if unknown
+int priority_parse(const char *name) {
+    for (int c = 0; c < VA_PRIO_CLASSES; c++) {
+        if (strcmp(name, VA_PRIO_NAMES[c]) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// Value of --name=value, or def if absent
+const char *opt(const char *name, const char *def) {
+    size_t len = strlen(name);
+    for (int i = 1; i < argc_g; i++) {
+        if (strncmp(argv_g[i], "--", 2) == 0 && strncmp(argv_g[i] + 2, name, len) == 0 && argv_g[i][2 + len] == '=') {
+            return argv_g[i] + 3 + len;
+        }
+    }
+    return def;
+}
+
+// True if --name was given
+bool has_flag(const char *name) {
+    for (int i = 1; i < argc_g; i++) {
+        if (strncmp(argv_g[i], "--", 2) == 0 && strcmp(argv_g[i] + 2, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
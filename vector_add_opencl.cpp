@@ -1,8 +1,8 @@
-#define CL_TARGET_OPENCL_VERSION 200 // Define OpenCL version 2.0
 #include <stdio.h>
 #include <stdlib.h>
-#include <CL/cl.h>
 #include <chrono>
+#include "ocl_common.h" // OpenCL headers, create_device() and build_program()
+#include "ocl_transfer.h" // Transfer modes (OCL_TRANSFER=pageable|mlock|pinned|migrate)
 
 #define PRINT 1 // Controls whether to print vectors
 int SZ = 100000000; // Default vector size (100 million elements)
@@ -17,12 +17,12 @@ cl_program program;            // OpenCL program
 cl_kernel kernel;              // OpenCL kernel
 cl_command_queue queue;        // Command queue for device operations
 cl_event event = NULL;         // Event for timing kernel execution
+OclTransfer xfer;              // Host/device transfer mode and staging buffers
 int err;                       // Error code for OpenCL calls
 
 // Function declarations
-cl_device_id create_device();
-void setup_openCL_device_context_queue_kernel(char *filename, char *kernelname);
-cl_program build_program(cl_context ctx, cl_device_id dev, const char *filename);
+bool setup_openCL_device_context_queue_kernel(char *filename, char *kernelname);
+void vector_add_cpu(int *v1, int *v2, int *v_out, int size);
 void setup_kernel_memory();
 void copy_kernel_args();
 void free_memory();
@@ -49,8 +49,29 @@ int main(int argc, char **argv) {
     printf("Vector v2:\n");
     print(v2, SZ);
     
-    // Set up OpenCL environment and kernel
-    setup_openCL_device_context_queue_kernel((char *)"./vector_ops_ocl.cl", (char *)"vector_add_ocl");
+    // Set up OpenCL environment and kernel; without a usable runtime or device, add on the CPU
+    if (!setup_openCL_device_context_queue_kernel((char *)"./vector_ops_ocl.cl", (char *)"vector_add_ocl")) {
+        fprintf(stderr, "WARNING: OpenCL is unavailable, falling back to the CPU\n");
+        auto start_cpu = std::chrono::high_resolution_clock::now();
+        vector_add_cpu(v1, v2, v_out, SZ);
+        auto stop_cpu = std::chrono::high_resolution_clock::now();
+        printf("Vector v_out (CPU fallback):\n");
+        print(v_out, SZ);
+        std::chrono::duration<double, std::milli> elapsed_cpu = stop_cpu - start_cpu;
+        printf("CPU Fallback Execution Time: %f ms\n", elapsed_cpu.count());
+        free(v1);
+        free(v2);
+        free(v_out);
+        return 0;
+    }
+    
+    // Record machine and OpenCL runtime settings and warn about ones that distort bandwidth
+    BenchEnv env;
+    env_capture(&env);
+    env_capture_opencl(&env, device_id);
+    env_print(&env, stdout);
+    env_warn(&env);
+    ocl_print_startup(stdout);
     
     // Allocate device memory and copy input data to device
     setup_kernel_memory();
@@ -67,7 +88,14 @@ int main(int argc, char **argv) {
     auto stop_ocl = std::chrono::high_resolution_clock::now();
     
     // Copy result back from device to host
-    clEnqueueReadBuffer(queue, bufV_out, CL_TRUE, 0, SZ * sizeof(int), &v_out[0], 0, NULL, NULL);
+    auto start_d2h = std::chrono::high_resolution_clock::now();
+    if (!xfer_download(&xfer, bufV_out, &v_out[0], SZ * sizeof(int))) {
+        exit(1);
+    }
+    auto stop_d2h = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> elapsed_d2h = stop_d2h - start_d2h;
+    printf("Device to host (%s): %f ms, %.2f GB/s\n", TRANSFER_MODE_NAMES[xfer.mode],
+           elapsed_d2h.count(), SZ * sizeof(int) / elapsed_d2h.count() / 1e6);
     
     // Print OpenCL result
     printf("Vector v_out (OpenCL):\n");
@@ -83,6 +111,14 @@ int main(int argc, char **argv) {
     return 0;
 }
 
+// Fallback when OpenCL cannot be set up: the same add on CPU threads (when built with -fopenmp)
+void vector_add_cpu(int *v1, int *v2, int *v_out, int size) {
+    #pragma omp parallel for
+    for (int i = 0; i < size; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+}
+
 // Initialize an array with random integers between 0 and 99
 void init(int *&A, int size) {
     A = (int *)malloc(sizeof(int) * size);
@@ -116,6 +152,7 @@ void print(int *A, int size) {
 // Free OpenCL resources and host memory
 void free_memory() {
     // Release OpenCL objects in reverse order of creation
+    xfer_release(&xfer);
     clReleaseMemObject(bufV1);
     clReleaseMemObject(bufV2);
     clReleaseMemObject(bufV_out);
@@ -150,109 +187,74 @@ void setup_kernel_memory() {
     bufV2 = clCreateBuffer(context, CL_MEM_READ_WRITE, SZ * sizeof(int), NULL, NULL);
     bufV_out = clCreateBuffer(context, CL_MEM_READ_WRITE, SZ * sizeof(int), NULL, NULL);
     
-    // Transfer input data from host to device
-    clEnqueueWriteBuffer(queue, bufV1, CL_TRUE, 0, SZ * sizeof(int), &v1[0], 0, NULL, NULL);
-    clEnqueueWriteBuffer(queue, bufV2, CL_TRUE, 0, SZ * sizeof(int), &v2[0], 0, NULL, NULL);
+    // Transfer mode from OCL_TRANSFER (default pageable)
+    const char *name = getenv("OCL_TRANSFER");
+    int mode = transfer_mode_parse(name != NULL ? name : "pageable");
+    if (mode < 0) {
+        printf("Unknown OCL_TRANSFER mode: %s (pageable, mlock, pinned or migrate)\n", name);
+        exit(1);
+    }
+    xfer_init(&xfer, context, queue, (TransferMode)mode);
+    
+    // Transfer input data from host to device; both writes overlap and are waited for together
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!xfer_upload(&xfer, bufV1, &v1[0], SZ * sizeof(int)) ||
+        !xfer_upload(&xfer, bufV2, &v2[0], SZ * sizeof(int))) {
+        exit(1);
+    }
+    xfer_output(&xfer, bufV_out);
+    xfer_finish(&xfer);
+    auto stop = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> elapsed = stop - start;
+    printf("Host to device (%s): %f ms, %.2f GB/s\n", TRANSFER_MODE_NAMES[mode],
+           elapsed.count(), 2.0 * SZ * sizeof(int) / elapsed.count() / 1e6);
 }
 
-// Set up OpenCL device, context, command queue, and kernel
-void setup_openCL_device_context_queue_kernel(char *filename, char *kernelname) {
+// Set up OpenCL device, context, command queue, and kernel; false (with a message and
+// nothing left allocated) if any step fails
+bool setup_openCL_device_context_queue_kernel(char *filename, char *kernelname) {
     device_id = create_device(); // Select GPU or CPU
+    if (device_id == NULL) {
+        return false;
+    }
     
     // Create OpenCL context for the selected device
+    auto start = std::chrono::high_resolution_clock::now();
     context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &err);
     if (err < 0) {
         perror("Couldn't create a context");
-        exit(1);
+        return false;
     }
+    auto stop = std::chrono::high_resolution_clock::now();
+    ocl_startup.context_ms += std::chrono::duration<double, std::milli>(stop - start).count();
     
     // Build program from source file
-    program = build_program(context, device_id, filename);
+    start = std::chrono::high_resolution_clock::now();
+    program = build_program(context, device_id, filename, NULL);
+    stop = std::chrono::high_resolution_clock::now();
+    ocl_startup.build_ms += std::chrono::duration<double, std::milli>(stop - start).count();
+    if (program == NULL) {
+        clReleaseContext(context);
+        return false;
+    }
     
     // Create command queue for the device
     queue = clCreateCommandQueueWithProperties(context, device_id, 0, &err);
     if (err < 0) {
         perror("Couldn't create a command queue");
-        exit(1);
+        clReleaseProgram(program);
+        clReleaseContext(context);
+        return false;
     }
     
     // Create kernel from the compiled program
     kernel = clCreateKernel(program, kernelname, &err);
     if (err < 0) {
         perror("Couldn't create a kernel");
-        exit(1);
+        clReleaseCommandQueue(queue);
+        clReleaseProgram(program);
+        clReleaseContext(context);
+        return false;
     }
-}
-
-// Build OpenCL program from source file
-cl_program build_program(cl_context ctx, cl_device_id dev, const char *filename) {
-    // Open program file
-    FILE *program_handle = fopen(filename, "r");
-    if (program_handle == NULL) {
-        perror("Couldn't find the program file");
-        exit(1);
-    }
-    
-    // Get file size
-    fseek(program_handle, 0, SEEK_END);
-    size_t program_size = ftell(program_handle);
-    rewind(program_handle);
-    
-    // Read the program source into a buffer
-    char *program_buffer = (char *)malloc(program_size + 1);
-    program_buffer[program_size] = '\0';
-    fread(program_buffer, sizeof(char), program_size, program_handle);
-    fclose(program_handle);
-    
-    // Create program from source
-    cl_program program = clCreateProgramWithSource(ctx, 1, (const char **)&program_buffer, &program_size, &err);
-    if (err < 0) {
-        perror("Couldn't create the program");
-        exit(1);
-    }
-    free(program_buffer);
-    
-    // Build program (compile and link)
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if (err < 0) {
-        // If build fails, get and print build log
-        size_t log_size;
-        clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        char *program_log = (char *)malloc(log_size + 1);
-        program_log[log_size] = '\0';
-        clGetProgramBuildInfo(program, dev, CL_PROGRAM_BUILD_LOG, log_size + 1, program_log, NULL);
-        printf("%s\n", program_log);
-        free(program_log);
-        exit(1);
-    }
-    
-    return program;
-}
-
-// Select a device (prefer GPU, fall back to CPU)
-cl_device_id create_device() {
-    cl_platform_id platform;
-    cl_device_id dev;
-    
-    // Get the first available platform
-    err = clGetPlatformIDs(1, &platform, NULL);
-    if (err < 0) {
-        perror("Couldn't identify a platform");
-        exit(1);
-    }
-    
-    // Try to get a GPU device first
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &dev, NULL);
-    if (err == CL_DEVICE_NOT_FOUND) {
-        // If no GPU is available, fall back to CPU
-        printf("GPU not found, falling back to CPU\n");
-        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &dev, NULL);
-    }
-    
-    if (err < 0) {
-        perror("Couldn't access any devices");
-        exit(1);
-    }
-    
-    return dev;
+    return true;
 }
@@ -1,7 +1,12 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <omp.h> // For OpenMP multi-threading
+#include "bench_env.h" // Machine settings recorded with the result
+#include "cgroup_limits.h" // Container CPU quota, cpuset and memory limit
+#include "cpu_kernels.h" // Tuned inner loops (see "vector_add_bench tune")
 
 #define PRINT 1 // Controls whether to print vectors
 int SZ = 100000000; // Default vector size (100 million elements)
@@ -9,27 +14,131 @@ int SZ = 100000000; // Default vector size (100 million elements)
 // Function declarations
 void init(int *&A, int size);
 void print(int *A, int size);
+bool ranges_overlap(const int *a, const int *b, int size);
+int self_check();
 
-// Multi-threaded CPU vector addition using OpenMP
-void vector_add_openmp(int *v1, int *v2, int *v_out, int size) {
+// True if [a, a + size) and [b, b + size) share any element. Compared as integers: relational
+// operators on pointers into different objects are unspecified.
+bool ranges_overlap(const int *a, const int *b, int size) {
+    uintptr_t pa = (uintptr_t)a, pb = (uintptr_t)b, bytes = (uintptr_t)size * sizeof(int);
+    return pa < pb + bytes && pb < pa + bytes;
+}
+
+// Fast path: output shares no memory with the inputs, so the compiler may assume no aliasing
+void vector_add_restrict(const int *__restrict v1, const int *__restrict v2, int *__restrict v_out, int size) {
+    // Use this host's tuned inner loop for the size class if it has been tuned
+    const CpuKernel *tuned = cpu_kernel_for_size(size);
+    if (tuned != NULL) {
+        cpu_add_parallel(tuned, v1, v2, v_out, size);
+        return;
+    }
+    
     #pragma omp parallel for // Parallelize the loop across CPU threads
     for (int i = 0; i < size; i++) {
         v_out[i] = v1[i] + v2[i]; // Compute sum for each element
     }
 }
 
+// In-place path: v_out is exactly v1 and/or v2; element i is read before it is written,
+// so any split across threads is still correct
+void vector_add_inplace(const int *v1, const int *v2, int *v_out, int size) {
+    #pragma omp parallel for
+    for (int i = 0; i < size; i++) {
+        v_out[i] = v1[i] + v2[i];
+    }
+}
+
+// Overlap path: v_out partially overlaps an input. Inputs that overlap are first copied
+// (in parallel) so the result is as if all inputs were read before any output was written,
+// like memmove; then the add runs on non-aliased memory.
+void vector_add_overlapping(int *v1, int *v2, int *v_out, int size) {
+    bool stage_v1 = ranges_overlap(v_out, v1, size) && v_out != v1;
+    bool stage_v2 = ranges_overlap(v_out, v2, size) && v_out != v2;
+    int *copy1 = stage_v1 ? (int *)malloc(sizeof(int) * size) : NULL;
+    int *copy2 = stage_v2 ? (int *)malloc(sizeof(int) * size) : NULL;
+    if ((stage_v1 && copy1 == NULL) || (stage_v2 && copy2 == NULL)) {
+        perror("Couldn't allocate staging buffer");
+        exit(1);
+    }
+    
+    // Stage the overlapping inputs
+    #pragma omp parallel for
+    for (int i = 0; i < size; i++) {
+        if (stage_v1) copy1[i] = v1[i];
+        if (stage_v2) copy2[i] = v2[i];
+    }
+    
+    // An input that is exactly v_out (not staged) is still read element by element before
+    // being written, so only the in-place kernel is safe here
+    const int *in1 = stage_v1 ? copy1 : v1;
+    const int *in2 = stage_v2 ? copy2 : v2;
+    if (ranges_overlap(v_out, in1, size) || ranges_overlap(v_out, in2, size)) {
+        vector_add_inplace(in1, in2, v_out, size);
+    } else {
+        vector_add_restrict(in1, in2, v_out, size);
+    }
+    free(copy1);
+    free(copy2);
+}
+
+// Multi-threaded CPU vector addition using OpenMP.
+// Any overlap between v_out and the inputs is allowed; the result is always v1 + v2 as they
+// were on entry. Disjoint buffers take the no-aliasing fast path.
+void vector_add_openmp(int *v1, int *v2, int *v_out, int size) {
+    bool overlap1 = ranges_overlap(v_out, v1, size);
+    bool overlap2 = ranges_overlap(v_out, v2, size);
+    
+    if (!overlap1 && !overlap2) {
+        vector_add_restrict(v1, v2, v_out, size); // Inputs may alias each other; both are read-only
+    } else if ((!overlap1 || v_out == v1) && (!overlap2 || v_out == v2)) {
+        vector_add_inplace(v1, v2, v_out, size);
+    } else {
+        vector_add_overlapping(v1, v2, v_out, size);
+    }
+}
+
 int main(int argc, char **argv) {
     int *v1, *v2, *v_out; // Host arrays for input and output vectors
     
+    // Check the aliasing paths instead of timing: ./vector_add_openmp --self-check
+    if (argc > 1 && strcmp(argv[1], "--self-check") == 0) {
+        return self_check();
+    }
+    
     // Allow vector size to be set via command-line argument
     if (argc > 1) {
         SZ = atoi(argv[1]);
     }
     
-    // Display the number of threads being used
-    int num_threads = omp_get_max_threads();
+    // Size the team to the container's CPU quota and cpuset, then display it
+    CgroupLimits cgroup;
+    cgroup_detect(&cgroup);
+    int num_threads = cgroup_apply_omp(&cgroup);
     printf("Running OpenMP implementation with %d threads\n", num_threads);
     
+    // Record machine settings and warn about ones that distort bandwidth
+    BenchEnv env;
+    env_capture(&env);
+    env_print(&env, stdout);
+    env_warn(&env);
+    
+    // Load the per-host tuning file if one exists
+    char tuning_path[300];
+    cpu_tuning_path(tuning_path, sizeof(tuning_path));
+    if (cpu_tuning_load(tuning_path)) {
+        char name[64];
+        const CpuKernel *tuned = cpu_kernel_for_size(SZ);
+        printf("Using tuned kernel %s from %s\n", tuned != NULL ? cpu_kernel_name(tuned, name, sizeof(name)) : "(none)", tuning_path);
+    }
+    
+    // The vectors must fit under the container's memory limit; past it the process is killed
+    long headroom = cgroup_memory_headroom(&cgroup);
+    if (headroom >= 0 && 3L * SZ * (long)sizeof(int) > headroom) {
+        fprintf(stderr, "Vectors need %ld MB but the cgroup memory limit leaves %ld MB\n",
+                3L * SZ * (long)sizeof(int) >> 20, headroom >> 20);
+        exit(1);
+    }
+    
     // Allocate and initialize vectors with random integers
     init(v1, SZ);
     init(v2, SZ);
@@ -62,6 +171,40 @@ int main(int argc, char **argv) {
     return 0;
 }
 
+// Run vector_add_openmp with v_out shifted -5..5 elements against v1, v2 and both (v1 == v2),
+// comparing with the sum of copies taken before the call; returns 1 on any mismatch
+int self_check() {
+    int failures = 0, cases = 0;
+    for (int size : {7, 1000, 100000}) {
+        int *buf = (int *)malloc(sizeof(int) * (3 * size + 20));
+        int *expect = (int *)malloc(sizeof(int) * size);
+        for (int target = 0; target < 3; target++) {
+            for (int shift = -5; shift <= 5; shift++) {
+                for (long i = 0; i < 3L * size + 20; i++) {
+                    buf[i] = rand() % 100;
+                }
+                // v1 and v2 are disjoint except when target == 2; v_out sits shift elements from the target
+                int *v1 = buf + 10;
+                int *v2 = target == 2 ? v1 : buf + 2 * size + 10;
+                int *v_out = (target == 1 ? v2 : v1) + shift;
+                for (int i = 0; i < size; i++) {
+                    expect[i] = v1[i] + v2[i];
+                }
+                vector_add_openmp(v1, v2, v_out, size);
+                cases++;
+                if (memcmp(v_out, expect, sizeof(int) * size) != 0) {
+                    fprintf(stderr, "FAIL: size %d, v_out = %s%+d\n", size, target == 0 ? "v1" : (target == 1 ? "v2" : "v1 = v2"), shift);
+                    failures++;
+                }
+            }
+        }
+        free(buf);
+        free(expect);
+    }
+    printf("Self-check: %d of %d aliasing cases correct\n", cases - failures, cases);
+    return failures > 0 ? 1 : 0;
+}
+
 // Initialize an array with random integers between 0 and 99
 void init(int *&A, int size) {
     A = (int *)malloc(sizeof(int) * size);
@@ -0,0 +1,380 @@
+// Shared worker pool for vector adds issued by many threads at once.
+//
+// Request threads of a server may call pool_vector_add() concurrently. Instead of every call
+// starting its own OpenMP team (J callers x T threads on T cores), all calls hand their work to
+// one pool of T workers. Each call is split into chunks and the workers take chunks from the
+// active calls in round-robin order, so a small call running next to a large one finishes after
+// a few chunks instead of waiting for the large one to drain.
+//
+// Calls may carry a priority class (0 = most urgent) and a deadline. Chunk boundaries are the
+// preemption points: each free worker takes its next chunk from the most urgent class with work
+// left, earliest deadline first within the class, round-robin among equals. Every
+// POOL_AGING_EVERY-th chunk goes to the least urgent class instead, so batch calls keep moving
+// while urgent ones are queued.
+//
+// Adds are memory-bandwidth bound: past a few threads per NUMA node, more threads only split
+// the same DRAM bandwidth. Workers are pinned, and each node has a number of worker slots
+// (all of its workers unless pool_calibrate() measured where its bandwidth saturates); workers
+// beyond the cap wait. The busy slots are shared between calls by class weight
+// (POOL_WEIGHTS): a call is offered a chunk only while it has fewer workers than its weighted
+// share of the slots, unless no call is under its share.
+//
+// OpenCL calls (pool_vector_add_ocl) share one context and built program, which the OpenCL API
+// allows from any thread, but each call creates its own command queue, kernel object and
+// buffers: kernel arguments belong to the kernel object, so a shared kernel is not reentrant.
+#pragma once
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <omp.h> // For the default pool size
+#include "ocl_common.h"
+
+#define POOL_CHUNK (64 * 1024) // Elements per chunk handed to a worker
+#define POOL_AGING_EVERY 8     // One chunk in this many goes to the least urgent class
+#define POOL_PRIORITY_NORMAL 1 // Class of calls that do not ask for one
+#define POOL_SATURATION 0.9    // Node cap: fewest workers reaching this share of peak bandwidth
+
+static const int POOL_WEIGHTS[] = {8, 4, 1}; // Slot weight per class; later classes weigh 1
+
+typedef std::chrono::steady_clock::time_point PoolTime;
+
+// One call in progress
+struct PoolJob {
+    const int *v1, *v2;
+    int *v_out;
+    long size;
+    long next;         // First element not yet handed out
+    long done;         // Elements finished
+    int priority;      // Class, 0 = most urgent
+    PoolTime deadline; // PoolTime::max() if none
+    PoolTime started;  // When the first chunk was handed out
+    int active;        // Workers adding a chunk of it right now
+    std::condition_variable finished;
+};
+
+// Workers and the calls they serve; all fields below the workers are guarded by mu
+struct WorkerPool {
+    std::vector<std::thread> workers;
+    std::vector<int> worker_node; // NUMA node of each worker's CPU
+    long chunk;
+    std::mutex mu;
+    std::condition_variable work;
+    std::vector<int> node_cap;    // Worker slots per node
+    std::vector<int> node_active; // Workers adding a chunk per node
+    std::vector<PoolJob *> jobs; // Calls with chunks left to hand out
+    size_t turn;                 // Round-robin position in jobs
+    long picks;                  // Chunks handed out, for aging
+    bool stop;
+};
+
+// Slot weight of a class
+static inline int pool_weight(int priority) {
+    return priority >= 0 && priority < (int)(sizeof(POOL_WEIGHTS) / sizeof(POOL_WEIGHTS[0])) ? POOL_WEIGHTS[priority] : 1;
+}
+
+// Index in jobs of the call whose chunk is next (called with mu held and jobs not empty).
+// Calls at their weighted share of the slots are skipped unless every call is.
+static inline size_t pool_pick(WorkerPool *p) {
+    int slots = 0, weights = 0;
+    for (int cap : p->node_cap) {
+        slots += cap;
+    }
+    for (const PoolJob *job : p->jobs) {
+        weights += pool_weight(job->priority);
+    }
+
+    size_t n = p->jobs.size();
+    size_t start = p->turn++ % n;
+    bool aging = ++p->picks % POOL_AGING_EVERY == 0;
+    for (int pass = 0; pass < 2; pass++) {
+        long best = -1;
+        for (size_t k = 0; k < n; k++) {
+            size_t i = (start + k) % n;
+            const PoolJob *a = p->jobs[i];
+            int share = slots * pool_weight(a->priority) / weights;
+            if (pass == 0 && a->active >= (share > 1 ? share : 1)) {
+                continue;
+            }
+            const PoolJob *b = best >= 0 ? p->jobs[best] : NULL;
+            bool better = b == NULL ||
+                (aging ? a->priority > b->priority
+                       : a->priority < b->priority || (a->priority == b->priority && a->deadline < b->deadline));
+            if (better) {
+                best = i;
+            }
+        }
+        if (best >= 0) {
+            return best;
+        }
+    }
+    return start;
+}
+
+// Worker: wait for a free slot on its node, take the next chunk (see pool_pick), add it
+static inline void pool_worker(WorkerPool *p, int node) {
+    std::unique_lock<std::mutex> lock(p->mu);
+    while (true) {
+        p->work.wait(lock, [&]() {
+            return p->stop || (!p->jobs.empty() && p->node_active[node] < p->node_cap[node]);
+        });
+        if (p->stop && p->jobs.empty()) {
+            return;
+        }
+
+        // Claim a chunk of the job whose turn it is
+        size_t j = pool_pick(p);
+        PoolJob *job = p->jobs[j];
+        long begin = job->next;
+        if (begin == 0) {
+            job->started = std::chrono::steady_clock::now();
+        }
+        long end = begin + p->chunk < job->size ? begin + p->chunk : job->size;
+        job->next = end;
+        if (end == job->size) {
+            p->jobs.erase(p->jobs.begin() + j); // Nothing left to hand out for this call
+        }
+        job->active++;
+        p->node_active[node]++;
+        lock.unlock();
+
+        for (long i = begin; i < end; i++) {
+            job->v_out[i] = job->v1[i] + job->v2[i];
+        }
+
+        lock.lock();
+        job->active--;
+        p->node_active[node]--;
+        job->done += end - begin;
+        if (job->done == job->size) {
+            job->finished.notify_one();
+        }
+    }
+}
+
+// NUMA node of a CPU from sysfs (0 if the kernel exposes no nodes)
+static inline int pool_cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    int node = 0;
+    if (dir != NULL) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (sscanf(entry->d_name, "node%d", &node) == 1) {
+                break;
+            }
+        }
+        closedir(dir);
+    }
+    return node;
+}
+
+// Start threads workers (0 = OpenMP's default team size), pinned round-robin to the CPUs
+// this process may use; every node starts with one slot per worker
+static inline void pool_start(WorkerPool *p, int threads, long chunk) {
+    p->chunk = chunk;
+    p->turn = 0;
+    p->picks = 0;
+    p->stop = false;
+    if (threads <= 0) {
+        threads = omp_get_max_threads();
+    }
+
+    std::vector<int> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &set)) {
+                cpus.push_back(c);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    for (int t = 0; t < threads; t++) {
+        int cpu = cpus[t % cpus.size()];
+        int node = pool_cpu_node(cpu);
+        p->worker_node.push_back(node);
+        if (node >= (int)p->node_cap.size()) {
+            p->node_cap.resize(node + 1, 0);
+            p->node_active.resize(node + 1, 0);
+        }
+        p->node_cap[node]++;
+    }
+    for (int t = 0; t < threads; t++) {
+        p->workers.emplace_back(pool_worker, p, p->worker_node[t]);
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[t % cpus.size()], &one);
+        pthread_setaffinity_np(p->workers[t].native_handle(), sizeof(one), &one);
+    }
+}
+
+// Set the worker slots of a node
+static inline void pool_set_node_cap(WorkerPool *p, int node, int cap) {
+    std::lock_guard<std::mutex> lock(p->mu);
+    p->node_cap[node] = cap;
+    p->work.notify_all();
+}
+
+// v_out = v1 + v2 on the pool with a priority class and deadline; safe to call from several
+// threads at once, returns when done. *started (if not NULL) receives when work began.
+static inline void pool_vector_add_sched(WorkerPool *p, const int *v1, const int *v2, int *v_out, long size,
+                                         int priority, PoolTime deadline, PoolTime *started) {
+    if (size <= 0) {
+        if (started != NULL) {
+            *started = std::chrono::steady_clock::now();
+        }
+        return;
+    }
+    PoolJob job;
+    job.v1 = v1;
+    job.v2 = v2;
+    job.v_out = v_out;
+    job.size = size;
+    job.next = 0;
+    job.done = 0;
+    job.priority = priority;
+    job.deadline = deadline;
+    job.active = 0;
+
+    std::unique_lock<std::mutex> lock(p->mu);
+    p->jobs.push_back(&job);
+    p->work.notify_all();
+    job.finished.wait(lock, [&]() { return job.done == job.size; });
+    if (started != NULL) {
+        *started = job.started;
+    }
+}
+
+// v_out = v1 + v2 on the pool in the normal class without a deadline
+static inline void pool_vector_add(WorkerPool *p, const int *v1, const int *v2, int *v_out, long size) {
+    pool_vector_add_sched(p, v1, v2, v_out, size, POOL_PRIORITY_NORMAL, PoolTime::max(), NULL);
+}
+
+// Measure each node's add bandwidth with 1, 2, ... of its workers and cap the node at the
+// fewest workers that reach POOL_SATURATION of its best; prints the curve to log if not NULL.
+// Each node is measured on its own vectors of size elements, first touched by its workers so
+// the pages are placed on it (large calloc blocks are fresh, untouched mappings).
+static inline void pool_calibrate(WorkerPool *p, long size, FILE *log) {
+    int nodes = (int)p->node_cap.size();
+    std::vector<int> workers(nodes, 0), caps(nodes, 0);
+    for (int node : p->worker_node) {
+        workers[node]++;
+    }
+    for (int node = 0; node < nodes; node++) {
+        if (workers[node] == 0) {
+            continue;
+        }
+        // Only this node's workers run; their writes place the new vectors' pages on the node
+        for (int other = 0; other < nodes; other++) {
+            pool_set_node_cap(p, other, other == node ? workers[node] : 0);
+        }
+        int *v1 = (int *)calloc(size, sizeof(int));
+        int *v2 = (int *)calloc(size, sizeof(int));
+        int *v_out = (int *)calloc(size, sizeof(int));
+        pool_vector_add(p, v1, v1, v1, size);
+        pool_vector_add(p, v2, v2, v2, size);
+        pool_vector_add(p, v1, v2, v_out, size);
+
+        // Best of three runs per worker count
+        std::vector<double> gbs(workers[node] + 1, 0);
+        double peak = 0;
+        for (int k = 1; k <= workers[node]; k++) {
+            pool_set_node_cap(p, node, k);
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::steady_clock::now();
+                pool_vector_add(p, v1, v2, v_out, size);
+                auto stop = std::chrono::steady_clock::now();
+                double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+                gbs[k] = std::max(gbs[k], 3.0 * size * sizeof(int) / ms / 1e6);
+            }
+            peak = std::max(peak, gbs[k]);
+        }
+        caps[node] = workers[node];
+        for (int k = workers[node]; k >= 1; k--) {
+            if (gbs[k] >= POOL_SATURATION * peak) {
+                caps[node] = k;
+            }
+        }
+        if (log != NULL) {
+            fprintf(log, "[pool] node %d:", node);
+            for (int k = 1; k <= workers[node]; k++) {
+                fprintf(log, " %d:%.1f", k, gbs[k]);
+            }
+            fprintf(log, " GB/s -> %d of %d workers\n", caps[node], workers[node]);
+        }
+        free(v1);
+        free(v2);
+        free(v_out);
+    }
+    for (int node = 0; node < nodes; node++) {
+        pool_set_node_cap(p, node, caps[node]);
+    }
+}
+
+// Finish outstanding calls and join the workers
+static inline void pool_stop(WorkerPool *p) {
+    {
+        std::lock_guard<std::mutex> lock(p->mu);
+        p->stop = true;
+    }
+    p->work.notify_all();
+    for (std::thread &t : p->workers) {
+        t.join();
+    }
+    p->workers.clear();
+}
+
+// v_out = v1 + v2 on the device of a shared backend, with a queue, kernel and buffers of its
+// own; safe to call from several threads at once. Returns false if a resource could not be made.
+static inline bool pool_vector_add_ocl(const OclBackend *shared, const int *v1, const int *v2, int *v_out, int size) {
+    cl_int err;
+    size_t bytes = size * sizeof(int);
+    cl_command_queue queue = clCreateCommandQueueWithProperties(shared->context, shared->device, 0, &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a command queue (error %d)\n", err);
+        return false;
+    }
+    cl_kernel kernel = clCreateKernel(shared->program, "vector_add_ocl", &err);
+    if (err < 0) {
+        fprintf(stderr, "Couldn't create a kernel (error %d)\n", err);
+        clReleaseCommandQueue(queue);
+        return false;
+    }
+    cl_int err1, err2, err3;
+    cl_mem bufV1 = clCreateBuffer(shared->context, CL_MEM_READ_ONLY, bytes, NULL, &err1);
+    cl_mem bufV2 = clCreateBuffer(shared->context, CL_MEM_READ_ONLY, bytes, NULL, &err2);
+    cl_mem bufV_out = clCreateBuffer(shared->context, CL_MEM_WRITE_ONLY, bytes, NULL, &err3);
+    bool ok = err1 >= 0 && err2 >= 0 && err3 >= 0;
+    if (ok) {
+        size_t global[1] = {(size_t)size};
+        clEnqueueWriteBuffer(queue, bufV1, CL_FALSE, 0, bytes, v1, 0, NULL, NULL);
+        clEnqueueWriteBuffer(queue, bufV2, CL_FALSE, 0, bytes, v2, 0, NULL, NULL);
+        clSetKernelArg(kernel, 0, sizeof(int), &size);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufV1);
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufV2);
+        clSetKernelArg(kernel, 3, sizeof(cl_mem), &bufV_out);
+        clEnqueueNDRangeKernel(queue, kernel, 1, NULL, global, NULL, 0, NULL, NULL);
+        clEnqueueReadBuffer(queue, bufV_out, CL_TRUE, 0, bytes, v_out, 0, NULL, NULL);
+    } else {
+        fprintf(stderr, "Couldn't create buffers for a call\n");
+    }
+    if (err1 >= 0) clReleaseMemObject(bufV1);
+    if (err2 >= 0) clReleaseMemObject(bufV2);
+    if (err3 >= 0) clReleaseMemObject(bufV_out);
+    clReleaseKernel(kernel);
+    clReleaseCommandQueue(queue);
+    return ok;
+}
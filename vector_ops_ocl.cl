@@ -0,0 +1,20 @@
+// Vector kernels. The element type is chosen at build time with -DT=<type> (default int).
+#ifndef T
+#define T int
+#endif
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable // Needed for -DT=double on OpenCL 1.x devices
+#endif
+
+// One work item per element: v_out = v1 + v2
+__kernel void vector_add_ocl(const int size, __global const T *v1, __global const T *v2, __global T *v_out) {
+    const int i = get_global_id(0);
+    if (i < size) {
+        v_out[i] = v1[i] + v2[i];
+    }
+}
+
+// Does nothing; used to measure launch overhead
+__kernel void empty_kernel() {
+}